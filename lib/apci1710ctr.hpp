@@ -0,0 +1,111 @@
+// apci1710ctr.hpp
+
+//
+// C++ wrapper of libapci1710ctr.  Errors are thrown as std::system_error.
+//
+//   apci1710ctr::Channel ch(0);
+//   std::vector<apci1710ctr::Record> recs(256);
+//   size_t n = ch.read(recs, 1000);
+//
+
+#ifndef __INC_apci1710ctr_hpp
+#define __INC_apci1710ctr_hpp
+
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <system_error>
+
+#include "libapci1710ctr.h"
+
+namespace apci1710ctr {
+
+typedef apci1710ctrRecord_t Record;
+
+class Channel {
+public:
+  explicit Channel(unsigned int minor, int flags = 0)
+    : ctr_(apci1710ctrOpenMinor(minor, flags))
+  {
+    if (!ctr_) {
+      fail("open");
+    }
+  }
+
+  explicit Channel(const std::string &path, int flags = 0)
+    : ctr_(apci1710ctrOpen(path.c_str(), flags))
+  {
+    if (!ctr_) {
+      fail("open " + path);
+    }
+  }
+
+  ~Channel() { apci1710ctrClose(ctr_); }
+
+  Channel(const Channel &) = delete;
+  Channel &operator=(const Channel &) = delete;
+
+  int fd() const { return apci1710ctrFd(ctr_); }
+  unsigned int minor() const { return apci1710ctrMinor(ctr_); }
+
+  void reset()      { check(apci1710ctrReset(ctr_), "reset"); }
+  void intEnable()  { check(apci1710ctrIntEnable(ctr_), "intEnable"); }
+  void intDisable() { check(apci1710ctrIntDisable(ctr_), "intDisable"); }
+  void setInputFilter(unsigned int filter) { check(apci1710ctrSetInputFilter(ctr_, filter), "setInputFilter"); }
+  void setChrono(const counterChrono_t &cfg) { check(apci1710ctrSetChrono(ctr_, &cfg), "setChrono"); }
+
+  counterStatsChannel_t stats()
+  {
+    counterStatsChannel_t st;
+    check(apci1710ctrGetStats(ctr_, &st), "stats");
+    return st;
+  }
+
+  unsigned int exceptions()
+  {
+    unsigned int exc;
+    check(apci1710ctrGetExceptions(ctr_, &exc), "exceptions");
+    return exc;
+  }
+
+  // Fills recs from the front, up to recs.size(); returns the number read,
+  // 0 on timeout.  timeoutMs -1 waits forever.
+  size_t read(std::vector<Record> &recs, int timeoutMs = -1)
+  {
+    ssize_t nn = apci1710ctrRead(ctr_, recs.data(), recs.size(), timeoutMs);
+    check(nn < 0 ? -1 : 0, "read");
+    return nn;
+  }
+
+  size_t readRaw(std::vector<counterBuf_t> &bufs, int timeoutMs = -1)
+  {
+    ssize_t nn = apci1710ctrReadRaw(ctr_, bufs.data(), bufs.size(), timeoutMs);
+    check(nn < 0 ? -1 : 0, "readRaw");
+    return nn;
+  }
+
+  // false when the latest-value page is not mapped
+  bool latest(counterLatest_t &lt)
+  {
+    return apci1710ctrLatest(ctr_, &lt) == 0;
+  }
+
+private:
+  static void fail(const std::string &what)
+  {
+    throw std::system_error(errno, std::generic_category(), "apci1710ctr: " + what);
+  }
+
+  static void check(int rv, const char *what)
+  {
+    if (rv < 0) {
+      fail(what);
+    }
+  }
+
+  apci1710ctr_t *ctr_;
+};
+
+} // namespace apci1710ctr
+
+#endif // __INC_apci1710ctr_hpp
@@ -0,0 +1,211 @@
+/**
+ * ----------------------------------------------------------------------------
+ * File       : apci1710ctr_archive.c
+ * Created    : 2026-10-19
+ * ----------------------------------------------------------------------------
+ * Description:
+ * Block encoder and decoder of the archive format, see
+ * apci1710ctr_archive.h.
+ * ----------------------------------------------------------------------------
+ * This file is part of apci1710ctrDriver. It is subject to
+ * the license terms in the LICENSE.txt file found in the top-level directory
+ * of this distribution and at:
+ *   https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of apci1710ctrDriver, including this file, may be
+ * copied, modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+**/
+
+#include <string.h>
+
+#include "apci1710ctr_archive.h"
+
+static uint8_t *putVarint(uint8_t *p, uint32_t v)
+{
+  while (v >= 0x80) {
+    *p++ = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (uint8_t)v;
+  return p;
+}
+
+/* NULL when the varint runs past end or is longer than 32 bits */
+static const uint8_t *getVarint(const uint8_t *p, const uint8_t *end, uint32_t *v)
+{
+  uint32_t shift = 0;
+
+  *v = 0;
+  while (p < end) {
+    *v |= (uint32_t)(*p & 0x7f) << shift;
+    if (!(*p++ & 0x80)) {
+      return p;
+    }
+    shift += 7;
+    if (shift > 28) {
+      return NULL;
+    }
+  }
+  return NULL;
+}
+
+static uint32_t zigzag(uint32_t delta)
+{
+  return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+}
+
+static uint32_t unzigzag(uint32_t v)
+{
+  return (v >> 1) ^ (uint32_t)-(int32_t)(v & 1);
+}
+
+/* ===== encoder ================================================= */
+
+void apci1710ctrArcBlockBegin(apci1710ctrArcCoder_t *c, void *block, size_t size,
+                              uint64_t firstSeq, uint64_t timeNs)
+{
+  apci1710ctrArcBlock_t *hdr = block;
+
+  memset(c, 0, sizeof(*c));
+  c->block = block;
+  c->size = size;
+  c->used = sizeof(apci1710ctrArcBlock_t);
+  c->seq = firstSeq;
+  hdr->firstSeq = firstSeq;
+  hdr->timeNs = timeNs;
+}
+
+int apci1710ctrArcAppend(apci1710ctrArcCoder_t *c, unsigned int channel,
+                         const counterBuf_t *rec, uint32_t lost)
+{
+  uint8_t *p = c->block + c->used;
+  uint8_t *tag = p++;
+  uint32_t bit = 1u << channel;
+
+  if ((channel >= APCI1710CTR_ARC_CHANNELS) || (c->used + APCI1710CTR_ARC_RECORD_MAX > c->size)) {
+    return -1;
+  }
+
+  *tag = (uint8_t)channel;
+  if (!(c->seen & bit) || (rec->frameCount != (uint16_t)(c->frame[channel] + 1))) {
+    *tag |= APCI1710CTR_ARC_FRAME;
+    p = putVarint(p, rec->frameCount);
+  }
+  if (rec->flags) {
+    *tag |= APCI1710CTR_ARC_FLAGS;
+    p = putVarint(p, rec->flags);
+  }
+  if (lost) {
+    *tag |= APCI1710CTR_ARC_LOST;
+    p = putVarint(p, lost);
+  }
+  if (!(c->seen & bit)) {
+    c->counter[channel] = c->timestamp[channel] = 0;
+  }
+  p = putVarint(p, zigzag((uint32_t)rec->counter - c->counter[channel]));
+  p = putVarint(p, zigzag(rec->timestamp - c->timestamp[channel]));
+
+  c->counter[channel] = (uint32_t)rec->counter;
+  c->timestamp[channel] = rec->timestamp;
+  c->frame[channel] = rec->frameCount;
+  c->seen |= bit;
+  c->used = p - c->block;
+  c->records++;
+  c->seq++;
+  return 0;
+}
+
+void apci1710ctrArcBlockEnd(apci1710ctrArcCoder_t *c)
+{
+  apci1710ctrArcBlock_t *hdr = (apci1710ctrArcBlock_t *)c->block;
+
+  hdr->magic = APCI1710CTR_ARC_BLOCK_MAGIC;
+  hdr->bytes = c->used - sizeof(apci1710ctrArcBlock_t);
+  hdr->records = c->records;
+  hdr->reserved = 0;
+  memset(c->block + c->used, 0, c->size - c->used);
+}
+
+/* ===== encoder === ^^^ ========================================= */
+
+/* ===== decoder ================================================= */
+
+int apci1710ctrArcBlockOpen(apci1710ctrArcCoder_t *c, const void *block, size_t size)
+{
+  const apci1710ctrArcBlock_t *hdr = block;
+
+  if ((size < sizeof(*hdr)) || (hdr->magic != APCI1710CTR_ARC_BLOCK_MAGIC) ||
+      (hdr->bytes > size - sizeof(*hdr))) {
+    return -1;
+  }
+  memset(c, 0, sizeof(*c));
+  c->block = (uint8_t *)block;
+  c->pos = c->block + sizeof(*hdr);
+  c->size = sizeof(*hdr) + hdr->bytes;
+  c->records = hdr->records;
+  c->seq = hdr->firstSeq;
+  return 0;
+}
+
+int apci1710ctrArcNext(apci1710ctrArcCoder_t *c, apci1710ctrArcRecord_t *out)
+{
+  const uint8_t *p = c->pos, *end = c->block + c->size;
+  uint32_t v, tag, ch, bit;
+
+  if (!c->records) {
+    return 0;
+  }
+  if (p >= end) {
+    return -1;
+  }
+  tag = *p++;
+  ch = tag & 0x1f;
+  bit = 1u << ch;
+  memset(out, 0, sizeof(*out));
+
+  if (tag & APCI1710CTR_ARC_FRAME) {
+    if (!(p = getVarint(p, end, &v))) {
+      return -1;
+    }
+    c->frame[ch] = (uint16_t)v;
+  } else if (c->seen & bit) {
+    c->frame[ch]++;
+  } else {
+    return -1;
+  }
+  if (tag & APCI1710CTR_ARC_FLAGS) {
+    if (!(p = getVarint(p, end, &v))) {
+      return -1;
+    }
+    out->rec.flags = (uint16_t)v;
+  }
+  if (tag & APCI1710CTR_ARC_LOST) {
+    if (!(p = getVarint(p, end, &out->lost))) {
+      return -1;
+    }
+  }
+  if (!(c->seen & bit)) {
+    c->counter[ch] = c->timestamp[ch] = 0;
+  }
+  if (!(p = getVarint(p, end, &v))) {
+    return -1;
+  }
+  c->counter[ch] += unzigzag(v);
+  if (!(p = getVarint(p, end, &v))) {
+    return -1;
+  }
+  c->timestamp[ch] += unzigzag(v);
+  c->seen |= bit;
+
+  out->seq = c->seq++;
+  out->channel = ch;
+  out->rec.counter = (int32_t)c->counter[ch];
+  out->rec.timestamp = c->timestamp[ch];
+  out->rec.frameCount = c->frame[ch];
+  c->pos = p;
+  c->records--;
+  return 1;
+}
+
+/* ===== decoder === ^^^ ========================================= */
@@ -0,0 +1,117 @@
+/* apci1710ctr_archive.h */
+
+/*
+ * On-disk archive format of tools/ctrarchive.
+ *
+ * file.a17    one apci1710ctrArcHeader_t in the first
+ *             APCI1710CTR_ARC_HEADER_SIZE bytes, then fixed-size blocks
+ * file.a17.idx  one apci1710ctrArcIndex_t per block, in file order
+ *
+ * Each block starts with an apci1710ctrArcBlock_t and decodes on its own,
+ * so a reader can start at any block found through the index (or by
+ * binary search on the block headers, which are at fixed offsets).
+ *
+ * Records are encoded as
+ *
+ *   byte    bits 0-4: channel (index into header.minor[])
+ *           bit 5: frame follows, else frame = previous frame + 1
+ *           bit 6: flags follow, else flags = 0
+ *           bit 7: lost count follows, else 0
+ *   [varint frameCount] [varint flags] [varint lost]
+ *   zigzag varint counter   - previous counter of the channel in the block
+ *   zigzag varint timestamp - previous timestamp of the channel in the block
+ *
+ * with differences taken modulo 2^32, so wraps cost nothing.  A record
+ * from a steadily moving encoder at a steady rate takes 4 to 6 bytes.
+ */
+
+#ifndef __INC_apci1710ctr_archive
+#define __INC_apci1710ctr_archive
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "apci1710ctr_buf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define APCI1710CTR_ARC_MAGIC         "A17CTRAR"
+#define APCI1710CTR_ARC_VERSION       1
+#define APCI1710CTR_ARC_HEADER_SIZE   4096
+#define APCI1710CTR_ARC_BLOCK_MAGIC   0x4b4c4243      /* "CBLK" */
+#define APCI1710CTR_ARC_BLOCK_DEFAULT 65536
+#define APCI1710CTR_ARC_BLOCK_MAX     (16 << 20)      /* largest blockSize accepted */
+#define APCI1710CTR_ARC_CHANNELS      32
+#define APCI1710CTR_ARC_RECORD_MAX    22              /* longest encoded record */
+
+#define APCI1710CTR_ARC_FRAME         0x20
+#define APCI1710CTR_ARC_FLAGS         0x40
+#define APCI1710CTR_ARC_LOST          0x80
+
+typedef struct apci1710ctrArcHeader {
+    char            magic[8];       /* APCI1710CTR_ARC_MAGIC, not terminated */
+    uint32_t        version;
+    uint32_t        headerSize;     /* offset of the first block */
+    uint32_t        blockSize;
+    uint32_t        channels;       /* entries used in minor[] */
+    uint64_t        createdNs;      /* CLOCK_REALTIME */
+    int64_t         monoToRealNs;   /* CLOCK_REALTIME - CLOCK_MONOTONIC at creation */
+    uint32_t        minor[APCI1710CTR_ARC_CHANNELS];
+} apci1710ctrArcHeader_t;
+
+typedef struct apci1710ctrArcBlock {
+    uint32_t        magic;          /* APCI1710CTR_ARC_BLOCK_MAGIC */
+    uint32_t        bytes;          /* encoded bytes after this header */
+    uint32_t        records;
+    uint32_t        reserved;
+    uint64_t        firstSeq;       /* archive sequence number of the first record */
+    uint64_t        timeNs;         /* CLOCK_REALTIME when the first record was read */
+} apci1710ctrArcBlock_t;
+
+typedef struct apci1710ctrArcIndex {
+    uint64_t        firstSeq;
+    uint64_t        timeNs;
+    uint64_t        offset;         /* of the block in the data file */
+    uint32_t        records;
+    uint32_t        reserved;
+} apci1710ctrArcIndex_t;
+
+/* one decoded record */
+typedef struct apci1710ctrArcRecord {
+    uint64_t        seq;
+    unsigned int    channel;        /* index into header.minor[] */
+    counterBuf_t    rec;
+    uint32_t        lost;           /* records lost to overflow before this one */
+} apci1710ctrArcRecord_t;
+
+typedef struct apci1710ctrArcCoder {
+    uint8_t *       block;          /* blockSize bytes, header first */
+    const uint8_t * pos;            /* decoder */
+    size_t          size;
+    size_t          used;
+    uint32_t        records;
+    uint64_t        seq;
+    uint32_t        seen;           /* channels with a previous record in the block */
+    uint32_t        counter[APCI1710CTR_ARC_CHANNELS];
+    uint32_t        timestamp[APCI1710CTR_ARC_CHANNELS];
+    uint16_t        frame[APCI1710CTR_ARC_CHANNELS];
+} apci1710ctrArcCoder_t;
+
+/* encoder: BlockBegin, Append until it fails, BlockEnd, write block */
+void   apci1710ctrArcBlockBegin(apci1710ctrArcCoder_t *c, void *block, size_t size,
+                                uint64_t firstSeq, uint64_t timeNs);
+int    apci1710ctrArcAppend(apci1710ctrArcCoder_t *c, unsigned int channel,
+                            const counterBuf_t *rec, uint32_t lost);    /* -1 = block full */
+void   apci1710ctrArcBlockEnd(apci1710ctrArcCoder_t *c);                /* fill in header, zero the rest */
+
+/* decoder: 0, or -1 when the block is not valid */
+int    apci1710ctrArcBlockOpen(apci1710ctrArcCoder_t *c, const void *block, size_t size);
+int    apci1710ctrArcNext(apci1710ctrArcCoder_t *c, apci1710ctrArcRecord_t *out);  /* 1, 0 = end, -1 = corrupt */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INC_apci1710ctr_archive */
@@ -0,0 +1,287 @@
+/**
+ * ----------------------------------------------------------------------------
+ * File       : libapci1710ctr.c
+ * Created    : 2026-10-19
+ * ----------------------------------------------------------------------------
+ * Description:
+ * User-space client library for the apci1710ctr driver, see
+ * libapci1710ctr.h.
+ * ----------------------------------------------------------------------------
+ * This file is part of apci1710ctrDriver. It is subject to
+ * the license terms in the LICENSE.txt file found in the top-level directory
+ * of this distribution and at:
+ *   https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of apci1710ctrDriver, including this file, may be
+ * copied, modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+**/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#include "libapci1710ctr.h"
+
+#define CHANNELS_PER_BOARD  4
+#define RAW_CHUNK           256     /* records per readv() in apci1710ctrRead() */
+
+struct apci1710ctrHandle {
+  int             fd;
+  int             flags;
+  unsigned int    minor;
+  const counterLatestPage_t * latest;   /* NULL = not mapped */
+  size_t          latestLen;
+
+  /* extension and loss state */
+  bool            started;
+  int64_t         counter;
+  uint64_t        frame;
+  unsigned int    overflowCount;
+
+  counterBuf_t    raw[RAW_CHUNK];
+};
+
+apci1710ctr_t *apci1710ctrOpen(const char *path, int flags)
+{
+  apci1710ctr_t *ctr = calloc(1, sizeof(*ctr));
+  counterStatsChannel_t stats;
+  long pageSize = sysconf(_SC_PAGESIZE);
+  void *page;
+  int err;
+
+  if (!ctr) {
+    return NULL;
+  }
+  ctr->flags = flags;
+  ctr->fd = open(path, O_RDONLY | O_NONBLOCK);
+  if (ctr->fd < 0) {
+    err = errno;
+    free(ctr);
+    errno = err;
+    return NULL;
+  }
+  if (ioctl(ctr->fd, APCI1710CTR_IOCGETSTATS, &stats)) {
+    err = errno;
+    apci1710ctrClose(ctr);
+    errno = err;
+    return NULL;
+  }
+  ctr->minor = stats.minor;
+  ctr->overflowCount = stats.overflowCount;
+
+  if (!(flags & APCI1710CTR_OPEN_NOLATEST)) {
+    page = mmap(NULL, pageSize, PROT_READ, MAP_SHARED, ctr->fd, 0);
+    if (page != MAP_FAILED) {
+      ctr->latest = page;
+      ctr->latestLen = pageSize;
+    }
+  }
+  return ctr;
+}
+
+apci1710ctr_t *apci1710ctrOpenMinor(unsigned int minor, int flags)
+{
+  char path[64];
+
+  snprintf(path, sizeof(path), APCI1710CTR_DEVPATH, minor);
+  return apci1710ctrOpen(path, flags);
+}
+
+void apci1710ctrClose(apci1710ctr_t *ctr)
+{
+  if (!ctr) {
+    return;
+  }
+  if (ctr->latest) {
+    munmap((void *)ctr->latest, ctr->latestLen);
+  }
+  close(ctr->fd);
+  free(ctr);
+}
+
+int apci1710ctrFd(const apci1710ctr_t *ctr)
+{
+  return ctr->fd;
+}
+
+unsigned int apci1710ctrMinor(const apci1710ctr_t *ctr)
+{
+  return ctr->minor;
+}
+
+/* ===== configuration =========================================== */
+
+int apci1710ctrReset(apci1710ctr_t *ctr)
+{
+  if (ioctl(ctr->fd, APCI1710CTR_IOCRESET)) {
+    return -1;
+  }
+  ctr->started = false;
+  ctr->counter = 0;
+  ctr->overflowCount = 0;
+  return 0;
+}
+
+int apci1710ctrIntEnable(apci1710ctr_t *ctr)
+{
+  return ioctl(ctr->fd, APCI1710CTR_IOCINTENABLE) ? -1 : 0;
+}
+
+int apci1710ctrIntDisable(apci1710ctr_t *ctr)
+{
+  return ioctl(ctr->fd, APCI1710CTR_IOCINTDISABLE) ? -1 : 0;
+}
+
+int apci1710ctrSetInputFilter(apci1710ctr_t *ctr, unsigned int filter)
+{
+  return ioctl(ctr->fd, APCI1710CTR_IOCSETINPUTFILTER, (unsigned long)filter) ? -1 : 0;
+}
+
+int apci1710ctrSetChrono(apci1710ctr_t *ctr, const counterChrono_t *cfg)
+{
+  return ioctl(ctr->fd, APCI1710CTR_IOCSETCHRONO, cfg) ? -1 : 0;
+}
+
+int apci1710ctrGetStats(apci1710ctr_t *ctr, counterStatsChannel_t *stats)
+{
+  return ioctl(ctr->fd, APCI1710CTR_IOCGETSTATS, stats) ? -1 : 0;
+}
+
+int apci1710ctrGetExceptions(apci1710ctr_t *ctr, unsigned int *exceptions)
+{
+  return ioctl(ctr->fd, APCI1710CTR_IOCGETEXCEPTIONS, exceptions) ? -1 : 0;
+}
+
+/* ===== configuration === ^^^ =================================== */
+
+/* ===== reading ================================================= */
+
+/* 1 when readable, 0 on timeout, -1 on error */
+static int waitReadable(apci1710ctr_t *ctr, int timeoutMs)
+{
+  struct pollfd pfd = { ctr->fd, POLLIN, 0 };
+  int rv;
+
+  do {
+    rv = poll(&pfd, 1, timeoutMs);
+  } while ((rv < 0) && (errno == EINTR));
+  return rv;
+}
+
+ssize_t apci1710ctrReadRaw(apci1710ctr_t *ctr, counterBuf_t *buf, size_t max, int timeoutMs)
+{
+  struct iovec iov;
+  ssize_t nn;
+
+  if (!max) {
+    return 0;
+  }
+  iov.iov_base = buf;
+  iov.iov_len = max * sizeof(counterBuf_t);
+  for (;;) {
+    /* readv() takes every waiting record that fits, read() only one */
+    nn = readv(ctr->fd, &iov, 1);
+    if (nn >= 0) {
+      return nn / sizeof(counterBuf_t);
+    }
+    if (errno != EAGAIN) {
+      return -1;
+    }
+    nn = waitReadable(ctr, timeoutMs);
+    if (nn <= 0) {
+      return nn;
+    }
+  }
+}
+
+/*
+ * extend -
+ *
+ * Widen one record: each value moves by the signed difference of the raw
+ * values, so wraps carry into the upper bits.  A pulse encoder record
+ * carries an interrupt mask, not a count, so it passes through unchanged
+ * and does not move the counter.
+ */
+static void extend(apci1710ctr_t *ctr, const counterBuf_t *raw, apci1710ctrRecord_t *rec)
+{
+  uint16_t expected = (uint16_t)(ctr->frame + 1);
+
+  rec->status = 0;
+  if (!ctr->started) {
+    ctr->frame = raw->frameCount;
+    ctr->started = true;
+    rec->status |= APCI1710CTR_REC_DISCONT;
+  } else {
+    if (raw->frameCount != expected) {
+      rec->status |= APCI1710CTR_REC_DISCONT;
+    }
+    ctr->frame += (uint16_t)(raw->frameCount - (uint16_t)ctr->frame);
+  }
+  if (raw->flags & APCI1710CTR_FLAG_PULSEENC) {
+    rec->counter = (uint32_t)raw->counter;
+  } else {
+    /* from 0 before the first counter record, which seeds it */
+    ctr->counter += (int32_t)((uint32_t)raw->counter - (uint32_t)ctr->counter);
+    rec->counter = ctr->counter;
+  }
+  rec->frame = ctr->frame;
+  rec->timestamp = raw->timestamp;
+  rec->flags = raw->flags;
+  rec->raw = (uint32_t)raw->counter;
+  rec->lost = 0;
+}
+
+ssize_t apci1710ctrRead(apci1710ctr_t *ctr, apci1710ctrRecord_t *rec, size_t max, int timeoutMs)
+{
+  counterStatsChannel_t stats;
+  ssize_t nn, ii, done = 0;
+
+  while (done < (ssize_t)max) {
+    nn = apci1710ctrReadRaw(ctr, ctr->raw, (max - done < RAW_CHUNK) ? max - done : RAW_CHUNK,
+                            done ? 0 : timeoutMs);
+    if (nn < 0) {
+      return done ? done : -1;
+    }
+    for (ii = 0; ii < nn; ii++) {
+      extend(ctr, ctr->raw + ii, rec + done + ii);
+    }
+    done += nn;
+    if (nn < RAW_CHUNK) {
+      break;
+    }
+  }
+
+  if (done && !(ctr->flags & APCI1710CTR_OPEN_NOLOSS) &&
+      !ioctl(ctr->fd, APCI1710CTR_IOCGETSTATS, &stats)) {
+    if (stats.overflowCount != ctr->overflowCount) {
+      /* a reset clears the count, so anything lower is new */
+      rec[0].lost = (stats.overflowCount > ctr->overflowCount) ?
+                    stats.overflowCount - ctr->overflowCount : stats.overflowCount;
+      rec[0].status |= APCI1710CTR_REC_LOST;
+      ctr->overflowCount = stats.overflowCount;
+    }
+  }
+  return done;
+}
+
+int apci1710ctrLatest(apci1710ctr_t *ctr, counterLatest_t *latest)
+{
+  if (!ctr->latest) {
+    errno = ENODEV;
+    return -1;
+  }
+  counterLatestRead(&ctr->latest->channel[ctr->minor % CHANNELS_PER_BOARD], latest);
+  return 0;
+}
+
+/* ===== reading === ^^^ ========================================= */
@@ -0,0 +1,87 @@
+/* libapci1710ctr.h */
+
+/*
+ * User-space client library for the apci1710ctr driver.
+ *
+ * A handle wraps one channel device.  apci1710ctrRead() fills a caller
+ * array with as many records as are waiting, in one readv(), extended to
+ * 64-bit counter and frame values and marked where records were lost.
+ * apci1710ctrLatest() reads the newest value from the mapped latest-value
+ * page without a system call.
+ */
+
+#ifndef __INC_libapci1710ctr
+#define __INC_libapci1710ctr
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "apci1710ctr_ioctl.h"
+#include "apci1710ctr_buf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define APCI1710CTR_DEVPATH         "/dev/apci1710ctr_%u"
+
+/* apci1710ctrOpen() flags */
+#define APCI1710CTR_OPEN_NOLATEST   0x0001  /* do not map the latest-value page */
+#define APCI1710CTR_OPEN_NOLOSS     0x0002  /* skip the overflow check after each read */
+
+/* apci1710ctrRecord_t status */
+#define APCI1710CTR_REC_LOST        0x0001  /* lost records precede this one */
+#define APCI1710CTR_REC_DISCONT     0x0002  /* frame count jumped: reset, or first record */
+
+typedef struct apci1710ctrRecord {
+    int64_t         counter;        /* counter value, extended across 32-bit wraps
+                                       (raw for APCI1710CTR_FLAG_PULSEENC) */
+    uint64_t        frame;          /* frameCount, extended across 16-bit wraps */
+    uint32_t        timestamp;      /* as in counterBuf_t */
+    uint16_t        flags;          /* APCI1710CTR_FLAG_* */
+    uint16_t        status;         /* APCI1710CTR_REC_* */
+    uint32_t        lost;           /* records lost to overflow before this one */
+    uint32_t        raw;            /* counter value as read */
+} apci1710ctrRecord_t;
+
+typedef struct apci1710ctrHandle apci1710ctr_t;
+
+/* NULL with errno set on failure; opening may reset the channel (openreset) */
+apci1710ctr_t * apci1710ctrOpen(const char *path, int flags);
+apci1710ctr_t * apci1710ctrOpenMinor(unsigned int minor, int flags);
+void            apci1710ctrClose(apci1710ctr_t *ctr);
+int             apci1710ctrFd(const apci1710ctr_t *ctr);
+unsigned int    apci1710ctrMinor(const apci1710ctr_t *ctr);
+
+/* configuration, 0 or -1 with errno set */
+int apci1710ctrReset(apci1710ctr_t *ctr);
+int apci1710ctrIntEnable(apci1710ctr_t *ctr);
+int apci1710ctrIntDisable(apci1710ctr_t *ctr);
+int apci1710ctrSetInputFilter(apci1710ctr_t *ctr, unsigned int filter);
+int apci1710ctrSetChrono(apci1710ctr_t *ctr, const counterChrono_t *cfg);
+int apci1710ctrGetStats(apci1710ctr_t *ctr, counterStatsChannel_t *stats);
+int apci1710ctrGetExceptions(apci1710ctr_t *ctr, unsigned int *exceptions);
+
+/*
+ * Read up to max records, waiting up to timeoutMs (-1 = forever, 0 = not
+ * at all) for the first.  Returns the number read, 0 on timeout, or -1
+ * with errno set.  Lost records are found from the driver's overflow
+ * count after each read; their exact position within the batch is not
+ * known, so they are reported on the first record of the batch.
+ */
+ssize_t apci1710ctrRead(apci1710ctr_t *ctr, apci1710ctrRecord_t *rec, size_t max, int timeoutMs);
+
+/* as apci1710ctrRead(), but records exactly as the driver queued them */
+ssize_t apci1710ctrReadRaw(apci1710ctr_t *ctr, counterBuf_t *buf, size_t max, int timeoutMs);
+
+/*
+ * Newest value of the channel from the latest-value page: 0, or -1 with
+ * errno ENODEV when the page is not mapped.  Does not consume records.
+ */
+int apci1710ctrLatest(apci1710ctr_t *ctr, counterLatest_t *latest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INC_libapci1710ctr */
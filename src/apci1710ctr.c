@@ -37,6 +37,12 @@
 #include <linux/poll.h>   // poll_table
 #include <linux/mutex.h>  // struct mutex
 #include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/mm.h>
+#include <linux/eventfd.h>
+#include <linux/capability.h>
+#include <linux/vmalloc.h>
 #include <asm/io.h>
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3,4,0)
   #include <asm/system.h>
@@ -52,11 +58,15 @@
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
 #include <linux/circ_buf.h>
+#include <linux/log2.h>
+#include <linux/seqlock.h>
 
 #include "apci1710.h"
 #include "apci1710-kapi.h"
 
 #include "apci1710ctr.h"
+#include "apci1710ctr_ring.h"
+#include "apci1710ctr_decode.h"
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("SLAC");
@@ -82,54 +92,141 @@ static int verbose = APCI1710CTR_VERBOSE_DEFAULT;
 module_param(verbose, int, 0644);
 MODULE_PARM_DESC(verbose, "Verbose (1=on, 0=off)");
 
+static int openreset = APCI1710CTR_OPENRESET_DEFAULT;
+module_param(openreset, int, 0644);
+MODULE_PARM_DESC(openreset, "Reset channel on open (1=on, 0=keep ring, counts and interrupt state)");
+
+static int inject = APCI1710CTR_INJECT_DEFAULT;
+module_param(inject, int, 0644);
+MODULE_PARM_DESC(inject, "Allow synthetic event injection for load tests (1=on, 0=off)");
+
+static unsigned int procmaxage = APCI1710CTR_PROCMAXAGE_DEFAULT;
+module_param(procmaxage, uint, 0644);
+MODULE_PARM_DESC(procmaxage, "Max age (us) of a cached /proc counter value, 0=always read the board (sysfs counter always does)");
+
+#ifdef APCI1710CTR_DEBUG
+/* fault injection, see /proc/driver/apci1710ctr/faults */
+static unsigned int faultdrop = APCI1710CTR_FAULT_DEFAULT;
+module_param(faultdrop, uint, 0644);
+MODULE_PARM_DESC(faultdrop, "Debug: drop every Nth latch interrupt (0=off)");
+
+static unsigned int faultdup = APCI1710CTR_FAULT_DEFAULT;
+module_param(faultdup, uint, 0644);
+MODULE_PARM_DESC(faultdup, "Debug: deliver every Nth latch interrupt twice (0=off)");
+
+static unsigned int faultdelay = APCI1710CTR_FAULT_DEFAULT;
+module_param(faultdelay, uint, 0644);
+MODULE_PARM_DESC(faultdelay, "Debug: delay reader wakeups by N us (0=off)");
+
+static unsigned int faultnomem = APCI1710CTR_FAULT_DEFAULT;
+module_param(faultnomem, uint, 0444);
+MODULE_PARM_DESC(faultnomem, "Debug: fail the Nth ring allocation at load (0=off)");
+
+static unsigned int faultkapi = APCI1710CTR_FAULT_DEFAULT;
+module_param(faultkapi, uint, 0644);
+MODULE_PARM_DESC(faultkapi, "Debug: fail every Nth checked kAPI call with -EIO (0=off)");
+#endif /* APCI1710CTR_DEBUG */
+
 EXPORT_NO_SYMBOLS;
 
-#define NUM_CTR_CHANNELS  4
+#define NUM_CTR_CHANNELS  4     /* module slots per board */
+#define MAX_BOARDS        8
 
 /* debug timing */
-#define STAT_HISTO_BINS   20
+#define STAT_HISTO_BINS   CTR_STAT_HISTO_BINS
 #define STAT_CHANNEL      1
 
 #define DEVNAME  "apci1710ctr"
 
+/* the aggregated stream follows the last channel */
+#define ALL_MINOR  (numBoards * NUM_CTR_CHANNELS)
+
 static const char modulename[] = DEVNAME;
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,0)
 static struct class * apci1710ctr_class = NULL;
 #endif
 
-static struct pci_dev *_pdev;
+struct counter_board;
 
 #ifdef INTENABLE_PROC
-static int apci1710_intEnable_all(void);
-static int apci1710_intDisable_all(void);
+static int apci1710_intEnable_all(struct counter_board *board);
+static int apci1710_intDisable_all(struct counter_board *board);
 #endif /* INTENABLE_PROC */
-static int apci1710_intEnable(int);
-static int apci1710_intDisable(int);
 
-/*
- * ring buffer
- *
- * The buffer's full or empty state can be resolved from the read and write pointers.
- * When the ptrs are equal, the buffer is empty.
- * When the read ptr is one greater than the write ptr, the buffer is full.
- * The capacity of the buffer is (_ringSize - 1) elements.
- */
+/* ring buffer, see apci1710ctr_ring.h */
 
 static unsigned _ringSize = APCI1710CTR_DEFAULT_RINGSIZE;
 
 typedef struct {
-  unsigned int      channelIndex;   /* index */
+  unsigned int      channelIndex;   /* module number on the board */
+  unsigned int      minor;          /* board * NUM_CTR_CHANNELS + channelIndex */
   struct pci_dev *  pdev;           /* vendor driver */
+  struct counter_board * board;
+  bool              present;        /* slot holds an incremental counter */
+  bool              intEnabled;     /* latch interrupt enabled */
 
   /* statistics */
   atomic_t interruptCount;
   atomic_t overflowCount;
   atomic_t frameCount;
+  ctrStat_t stat;                   /* debug timing */
+
+  /* timestamp source */
+  int chronoModule;                 /* paired chronometer module, -1 = none */
+  u64 chronoUnitNs;                 /* nominal ns per chronometer count */
+  u64 chronoTimeNs;                 /* board-clocked time of the last trigger */
+  u64 chronoCpuNs;                  /* CPU time of the last trigger, 0 = none yet */
+
+  /* pulse encoder output */
+  int pulseEncModule;               /* driven pulse encoder module, -1 = none */
+  int pulseEncoder;                 /* pulse encoder within that module */
+
+  /* scheduled digital output */
+  struct hrtimer digoutTimer;
+  bool digoutArmed;                 /* start a pulse on the next latch event */
+  int digoutPhase;                  /* 0 = leading edge next, 1 = trailing edge next */
+  counterDigoutPulse_t digoutPulse;
+  int elModule;                     /* EL timer module in use, -1 = none */
+
+  /* threshold reflex */
+  counterReflex_t reflex;
+  int reflexRegion;                 /* current region, -1 = unknown */
+
+  /* capture group */
+  bool groupMember;                 /* in the capture group, under the board lock */
+  unsigned int groupPending;        /* group software latches not yet seen by the ISR */
+
+  /* synthetic events, under the board lock */
+  struct hrtimer injectTimer;
+  u64 injectPeriod;                 /* ns */
+  unsigned int injectRemaining;
+  uint32_t injectValue;
+  uint32_t injectStep;
+
+  /* recorded events, under the board lock */
+  struct hrtimer replayTimer;
+  counterBuf_t *replayBuf;          /* NULL = idle, replaced under lock */
+  unsigned int replayCount;
+  unsigned int replayNext;          /* next record to queue */
+  unsigned int replaySpeed;
+  ktime_t replayStart;
+  u64 replayElapsed;                /* recorded us from the first record to replayNext */
+
+#ifdef APCI1710CTR_DEBUG
+  /* fault injection */
+  unsigned int faultSeq;            /* latch interrupts seen, under the board lock */
+  struct hrtimer faultWakeTimer;
+  atomic_t faultDropped;
+  atomic_t faultDuplicated;
+  atomic_t faultDelayed;
+#endif
+
+  /* aggregated stream */
+  uint16_t allFrameCount;           /* events offered to it, under its lock */
 
   /* input buffer */
-  counterBuf_t * ringBuf;
-  struct circ_buf ring;
+  ctrRing_t ring;
 
   /* lock */
   struct mutex lock;
@@ -137,23 +234,83 @@ typedef struct {
   /* read queue */
   wait_queue_head_t inq;
 
+  /* asynchronous notification, armed again by each read */
+  struct fasync_struct *fasync;
+  struct eventfd_ctx *eventfd;      /* changed under the board lock */
+  struct file *eventfdOwner;
+  bool readyArmed;
+  bool overflowArmed;
+
+  /* counter_file_t of each open fd, under the board lock */
+  struct list_head files;
+
   /* char device */
   struct cdev cdev;
   struct device *dev;
 
+  /* proc */
+  struct proc_dir_entry *proc_dir;
+
+  /* last board read of the counter, see apci1710_counterCachedRead() */
+  seqlock_t counterCache;
+  uint32_t counterCacheValue;
+  u64 counterCacheTime;             /* ktime_get_ns() of the read, 0 = none */
+  u64 counterCacheSince;            /* counter last written, older latches are stale */
+  atomic_t counterCacheHits;
+
 } counter_channel_t;
 
-/* statically allocate */
-static counter_channel_t counter_channel[NUM_CTR_CHANNELS];
+/*
+ * One open fd of a channel, in filp->private_data.  Exceptions are kept
+ * per fd so that a change is reported to the other readers only, and
+ * only to those that asked for exceptions.
+ */
+typedef struct counter_file {
+  counter_channel_t *pchan;
+  struct list_head node;            /* on pchan->files */
+  bool exceptionsOn;                /* set by the first APCI1710CTR_IOCGETEXCEPTIONS */
+  unsigned int exceptions;          /* APCI1710CTR_EXC_*, under the board lock */
+} counter_file_t;
+
+/*
+ * One board known to the vendor driver.  All hardware access goes
+ * through the board's own lock, apci1710_lock(board->pdev).
+ */
+typedef struct counter_board {
+  unsigned int      boardIndex;
+  struct pci_dev *  pdev;
+
+  counter_channel_t * channel;      /* NUM_CTR_CHANNELS, indexed by module number */
+
+  /* channel owning each pulse encoder module, indexed by module number */
+  counter_channel_t * pulseEncOwner[NUM_CTR_CHANNELS];
+
+  /* channel paired with each chronometer module, indexed by module number */
+  counter_channel_t * chronoOwner[NUM_CTR_CHANNELS];
+
+  /* channel using each EL timer module for its pulses, indexed by module number */
+  counter_channel_t * elOwner[NUM_CTR_CHANNELS];
+
+  /* detected module layout, indexed by module number */
+  uint32_t moduleId[NUM_CTR_CHANNELS];
+  uint32_t moduleFunctionality[NUM_CTR_CHANNELS];
+
+  /* latest-value page, written under the board lock */
+  counterLatestPage_t * latest;
+
+  /* proc */
+  struct proc_dir_entry *proc_dir;
+} counter_board_t;
+
+/* allocated at load time, one per board */
+static counter_board_t *boards[MAX_BOARDS];
+static unsigned int numBoards;
 
 /* proc */
 
-#define CTR_PROC_DIRNAME0 "driver/apci1710ctr0"
-#define CTR_PROC_DIRNAME1 "driver/apci1710ctr1"
-#define CTR_PROC_DIRNAME2 "driver/apci1710ctr2"
-#define CTR_PROC_DIRNAME3 "driver/apci1710ctr3"
+#define CTR_PROC_DIRNAME  "driver/apci1710ctr"    /* board entries; channel N in CTR_PROC_DIRNAME "N" */
 
-struct proc_dir_entry *proc_parent[NUM_CTR_CHANNELS];
+struct proc_dir_entry *proc_top;
 
 void apci1710ctr_proc_create(void);
 void apci1710ctr_proc_remove(void);
@@ -163,42 +320,273 @@ void apci1710ctr_proc_remove(void);
 
 /* ring buffer methods */
 static unsigned int ringbufLevel(counter_channel_t *pchan);
-static bool ringbufPushLocked(counter_channel_t *pchan, int32_t counter);
-static bool ringbufPop(counter_channel_t *pchan, int32_t *counter, uint16_t *frameCount, uint16_t *flags, uint32_t *timestamp);
+static bool ringbufPushLocked(counter_channel_t *pchan, int32_t counter, uint32_t timestamp, uint16_t flags);
+static bool ringbufPop(counter_channel_t *pchan, counterBuf_t *el);
+static void allbufPushLocked(counter_channel_t *pchan, int32_t counter, uint32_t timestamp, uint16_t flags);
+static void latestUpdateLocked(counter_channel_t *pchan, int32_t counter, uint32_t timestamp,
+                               uint16_t frameCount, uint16_t flags);
+static void notifyLocked(counter_channel_t *pchan, int band);
+static void latestGet(counter_channel_t *pchan, counterLatest_t *dst);
 void ringbufReset(counter_channel_t *pchan);
 
-static int counterModuleInit(void)
+static enum hrtimer_restart apci1710_digoutTimer(struct hrtimer *timer);
+static enum hrtimer_restart apci1710_injectTimer(struct hrtimer *timer);
+static enum hrtimer_restart apci1710_replayTimer(struct hrtimer *timer);
+static void apci1710_replayStop(counter_channel_t *pchan);
+
+/* fault injection, nothing at all unless APCI1710CTR_DEBUG */
+#ifdef APCI1710CTR_DEBUG
+static int faultLatchLocked(counter_channel_t *pchan);
+static bool faultWakeDelayLocked(counter_channel_t *pchan);
+static void *faultKmalloc(size_t size, gfp_t flags);
+static bool faultKapi(void);
+static enum hrtimer_restart apci1710_faultWakeTimer(struct hrtimer *timer);
+#define FAULT_KAPI(call)              (faultKapi() ? -EIO : (call))
+#else
+#define faultLatchLocked(pchan)       1
+#define faultWakeDelayLocked(pchan)   false
+#define faultKmalloc(size, flags)     kmalloc(size, flags)
+#define FAULT_KAPI(call)              (call)
+#endif
+
+static int apci1710_intEnable(counter_channel_t *pchan);
+static int apci1710_intDisable(counter_channel_t *pchan, counter_file_t *origin);
+static bool exceptionRaiseLocked(counter_channel_t *pchan, unsigned int bits, counter_file_t *origin);
+
+/*
+ * capture group
+ *
+ * The group lock serializes captures, which may come from the ioctl or
+ * from the group hrtimer.  It is taken before any board lock.
+ */
+#define GROUP_MIN_PERIOD  10000     /* ns */
+
+typedef struct {
+  spinlock_t lock;
+  struct mutex configLock;          /* serializes IOCSETGROUP */
+  struct hrtimer timer;
+  u64 period;                       /* ns, 0 = triggered by ioctl only */
+  unsigned int count;
+  counter_channel_t * member[APCI1710CTR_GROUP_MAX];
+  uint32_t seq;
+  counterGroupStatus_t status;
+} counter_group_t;
+
+static counter_group_t captureGroup;
+
+/*
+ * aggregated stream
+ *
+ * Every record pushed to any channel is also pushed here, in push order,
+ * while /dev/apci1710ctr_all is open.  The lock is taken inside the board
+ * locks, since pushes from different boards can run concurrently.
+ */
+typedef struct {
+  spinlock_t lock;
+  bool open;
+  unsigned int size;
+  counterAllBuf_t * ringBuf;
+  struct circ_buf ring;
+  atomic_t overflowCount;
+
+  struct mutex readLock;
+  wait_queue_head_t inq;
+
+  struct cdev cdev;
+  struct device *dev;
+} counter_all_t;
+
+static counter_all_t allStream;
+
+static int counterModuleFini(counter_board_t *board);
+static void chronoReleaseLocked(counter_channel_t *pchan);
+static void apci1710_digoutStop(counter_channel_t *pchan);
+
+static int counterModuleInit(counter_board_t *board)
 {
   int ii;
+  counter_channel_t *pchan;
+
+  BUILD_BUG_ON(sizeof(counterLatestPage_t) > PAGE_SIZE);
+  BUILD_BUG_ON(ARRAY_SIZE(board->latest->channel) != NUM_CTR_CHANNELS);
+
+  board->channel = kcalloc(NUM_CTR_CHANNELS, sizeof(counter_channel_t), GFP_KERNEL);
+  if (!board->channel) {
+    return -ENOMEM;
+  }
+
+  board->latest = (counterLatestPage_t *) get_zeroed_page(GFP_KERNEL);
+  if (!board->latest) {
+    kfree(board->channel);
+    board->channel = NULL;
+    return -ENOMEM;
+  }
+  board->latest->version = APCI1710CTR_LATEST_VERSION;
+  board->latest->board = board->boardIndex;
+  board->latest->channels = NUM_CTR_CHANNELS;
+
   for (ii = 0; ii < NUM_CTR_CHANNELS; ii++) {
-    counter_channel[ii].pdev = _pdev;
-    counter_channel[ii].channelIndex = ii;
-    atomic_set(&counter_channel[ii].interruptCount, 0);
-    atomic_set(&counter_channel[ii].overflowCount, 0);
-    atomic_set(&counter_channel[ii].frameCount, 0);
+    pchan = board->channel + ii;
+    pchan->pdev = board->pdev;
+    pchan->board = board;
+    pchan->channelIndex = ii;
+    pchan->minor = board->boardIndex * NUM_CTR_CHANNELS + ii;
+    pchan->present = (board->moduleFunctionality[ii] == APCI1710_INCREMENTAL_COUNTER);
+    atomic_set(&pchan->interruptCount, 0);
+    atomic_set(&pchan->overflowCount, 0);
+    atomic_set(&pchan->frameCount, 0);
+    pchan->chronoModule = -1;
+    pchan->pulseEncModule = -1;
+    pchan->pulseEncoder = 0;
+    pchan->digoutArmed = false;
+    pchan->elModule = -1;
+    pchan->reflex.count = 0;
+    pchan->reflexRegion = -1;
+    hrtimer_init(&pchan->digoutTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    pchan->digoutTimer.function = apci1710_digoutTimer;
+    hrtimer_init(&pchan->injectTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    pchan->injectTimer.function = apci1710_injectTimer;
+    pchan->injectRemaining = 0;
+    hrtimer_init(&pchan->replayTimer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    pchan->replayTimer.function = apci1710_replayTimer;
+    pchan->replayBuf = NULL;
+#ifdef APCI1710CTR_DEBUG
+    hrtimer_init(&pchan->faultWakeTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    pchan->faultWakeTimer.function = apci1710_faultWakeTimer;
+    atomic_set(&pchan->faultDropped, 0);
+    atomic_set(&pchan->faultDuplicated, 0);
+    atomic_set(&pchan->faultDelayed, 0);
+#endif
+
+    /* allocate ring buffer for counter slots only */
+    ctrRingInit(&pchan->ring, pchan->present ? faultKmalloc(_ringSize * sizeof(counterBuf_t), GFP_KERNEL) : NULL,
+                _ringSize);
+
+    /* initialize read queue and mutex */
+    init_waitqueue_head(&pchan->inq);
+    mutex_init(&pchan->lock);
+
+    pchan->fasync = NULL;
+    pchan->eventfd = NULL;
+    pchan->readyArmed = pchan->overflowArmed = true;
+    INIT_LIST_HEAD(&pchan->files);
 
-    /* allocate ring buffer */
-    counter_channel[ii].ringBuf = kmalloc(_ringSize * sizeof(counterBuf_t), GFP_KERNEL);
+    seqlock_init(&pchan->counterCache);
+    pchan->counterCacheTime = pchan->counterCacheSince = 0;
+    atomic_set(&pchan->counterCacheHits, 0);
+  }
 
-    /* clear ring buffer */
-    counter_channel[ii].ring.head = counter_channel[ii].ring.tail = 0;
+  /* the interrupt routine pushes to any present channel */
+  for (ii = 0; ii < NUM_CTR_CHANNELS; ii++) {
+    if (board->channel[ii].present && !board->channel[ii].ring.buf) {
+      printk("%s: ring allocation failed on board %u\n", modulename, board->boardIndex);
+      counterModuleFini(board);
+      return -ENOMEM;
+    }
   }
   return 0;
 }
 
-static int counterModuleFini(void)
+/*
+ * counterBoardQuiesce -
+ *
+ * Stop the board calling apci1710_interrupt(): disable the latch
+ * interrupt of every channel and reset the board interrupt routine, in
+ * one hold of the board lock so that a callback already running on
+ * another CPU has finished.  Called on unload before any hrtimer is
+ * cancelled or anything the interrupt routine uses is freed.
+ */
+static void counterBoardQuiesce(counter_board_t *board)
+{
+  unsigned long irqstate;
+  int ii;
+
+  if (!board->channel) {
+    return;
+  }
+  apci1710_lock(board->pdev, &irqstate);
+  for (ii = 0; ii < NUM_CTR_CHANNELS; ii++) {
+    if (board->channel[ii].present) {
+      (void) i_APCI1710_DisableLatchInterrupt(board->pdev, ii);
+      board->channel[ii].intEnabled = false;
+      board->channel[ii].groupPending = 0;
+      board->channel[ii].digoutArmed = false;
+    }
+  }
+  (void) i_APCI1710_ResetBoardIntRoutine(board->pdev);
+
+  /* and give up the modules the channels use */
+  for (ii = 0; ii < NUM_CTR_CHANNELS; ii++) {
+    if (board->channel[ii].present) {
+      chronoReleaseLocked(board->channel + ii);
+    }
+  }
+  apci1710_unlock(board->pdev, irqstate);
+}
+
+/* the board must be quiesced, or never have had its interrupts on */
+static int counterModuleFini(counter_board_t *board)
 {
   /* free ring buffers */
 
   int ii;
+  if (!board->channel) {
+    return 0;
+  }
   for (ii = NUM_CTR_CHANNELS - 1; ii >= 0; ii--) {
-    if (!IS_ERR(counter_channel[ii].ringBuf)) {
-      kfree(counter_channel[ii].ringBuf);
+    apci1710_digoutStop(&board->channel[ii]);
+    hrtimer_cancel(&board->channel[ii].injectTimer);
+    apci1710_replayStop(&board->channel[ii]);
+#ifdef APCI1710CTR_DEBUG
+    hrtimer_cancel(&board->channel[ii].faultWakeTimer);
+#endif
+    if (board->channel[ii].eventfd) {
+      eventfd_ctx_put(board->channel[ii].eventfd);
+    }
+    if (!IS_ERR_OR_NULL(board->channel[ii].ring.buf)) {
+      kfree(board->channel[ii].ring.buf);
     }
   }
+  kfree(board->channel);
+  board->channel = NULL;
+  free_page((unsigned long) board->latest);
+  board->latest = NULL;
   return 0;
 }
 
+/*
+ * boardFromPdev -
+ *
+ * Find the board an interrupt callback was called for.
+ */
+static counter_board_t *boardFromPdev(struct pci_dev *pdev)
+{
+  unsigned int ii;
+
+  for (ii = 0; ii < numBoards; ii++) {
+    if (boards[ii]->pdev == pdev) {
+      return boards[ii];
+    }
+  }
+  return NULL;
+}
+
+/*
+ * channelFromMinor -
+ *
+ * Find a counter channel by minor number; NULL if there is none.
+ */
+static counter_channel_t *channelFromMinor(unsigned int minor)
+{
+  counter_channel_t *pchan;
+
+  if (minor >= numBoards * NUM_CTR_CHANNELS) {
+    return NULL;
+  }
+  pchan = boards[minor / NUM_CTR_CHANNELS]->channel + (minor % NUM_CTR_CHANNELS);
+  return pchan->present ? pchan : NULL;
+}
+
 static int overflowCountGet(counter_channel_t *pchan)
 {
   return atomic_read(&pchan->overflowCount);
@@ -246,898 +634,2849 @@ static void interruptCountClear(counter_channel_t *pchan)
 
 /* debug timing */
 
-typedef struct {
-  int histo[STAT_HISTO_BINS];
-  bool histoEnabled;
-  bool first;
-  unsigned long prev_jiffies;
-  bool ignoreEnabled;
-  long ignoreCount;
-} stat_t;
-
-stat_t stat[NUM_CTR_CHANNELS];
+static void statStart(counter_channel_t *pchan)
+{
+  ctrStatStart(&pchan->stat);
+}
 
-static void statStart(int channel)
+static void statStop(counter_channel_t *pchan)
 {
-  stat[channel].first = true;
-  stat[channel].histoEnabled = true;
+  ctrStatStop(&pchan->stat);
 }
 
-static void statStop(int channel)
+static void statReset(counter_channel_t *pchan)
 {
-  stat[channel].histoEnabled = false;
+  ctrStatReset(&pchan->stat);
 }
 
-static void statReset(int channel)
+/* ===== scheduled digital output ================================ */
+
+/* must be called with the board lock HELD */
+static void apci1710_digoutSetLocked(counter_channel_t *pchan, bool on)
 {
-  int jj;
-  for (jj = 0; jj < STAT_HISTO_BINS; jj++) {
-    stat[channel].histo[jj] = 0;
+  if (on) {
+    (void) i_APCI1710_SetDigitalChlOn(pchan->pdev, pchan->channelIndex);
+  } else {
+    (void) i_APCI1710_SetDigitalChlOff(pchan->pdev, pchan->channelIndex);
   }
-  stat[channel].ignoreCount = 0;
 }
 
-static void apci1710_interrupt (struct pci_dev * pdev)
+/*
+ * apci1710_digoutStartLocked -
+ *
+ * Start a scheduled pulse delay ns from now.  A zero delay sets the
+ * leading edge immediately.
+ * This routine must be called with the board lock HELD.
+ */
+static void apci1710_digoutStartLocked(counter_channel_t *pchan, u64 delay)
 {
-  uint8_t   mm;
-  uint32_t  im;
-  int32_t   latch;
-  counter_channel_t *pchan;
-  unsigned long jiffy = jiffies;    /* kernel tick count */
-  int diffy;
-
-  if (_pdev) {
-    (void) i_APCI1710_TestInterrupt(_pdev, &mm, &im, (uint32_t *)&latch);
-    if (mm < NUM_CTR_CHANNELS) {
-      pchan = counter_channel + mm;
-      interruptCountIncrement(pchan);
+  pchan->digoutPhase = 0;
+  if (delay) {
+    hrtimer_start(&pchan->digoutTimer, ns_to_ktime(delay), HRTIMER_MODE_REL);
+  } else {
+    apci1710_digoutSetLocked(pchan, pchan->digoutPulse.level);
+    if (pchan->digoutPulse.width) {
+      pchan->digoutPhase = 1;
+      hrtimer_start(&pchan->digoutTimer, ns_to_ktime(pchan->digoutPulse.width), HRTIMER_MODE_REL);
+    } else if (pchan->digoutPulse.repeat &&
+               (pchan->digoutPulse.trigger == APCI1710CTR_DIGOUT_AFTERLATCH)) {
+      pchan->digoutArmed = true;
+    }
+  }
+}
 
-      /* callback already holds spinlock */
-      ringbufPushLocked(pchan, latch);
+static enum hrtimer_restart apci1710_digoutTimer(struct hrtimer *timer)
+{
+  counter_channel_t *pchan = container_of(timer, counter_channel_t, digoutTimer);
+  enum hrtimer_restart rv = HRTIMER_NORESTART;
+  unsigned long irqstate;
 
-      /* debug */
-      if ((mm == STAT_CHANNEL) && stat[mm].histoEnabled) {
-        if (stat[mm].first) {
-          stat[mm].prev_jiffies = jiffy;
-          stat[mm].first = false;
-        } else {
-          diffy = jiffy - stat[mm].prev_jiffies;
-          if (diffy < 0) {
-            printk("%s: %s: Error: diffy=%d\n", modulename, __FUNCTION__, diffy);
-          } else if (diffy < 8 && stat[mm].ignoreEnabled) {
-            /* IGNORE short trigger interval */
-            ++ stat[mm].ignoreCount;
-          } else {
-            /* fill histogram */
-            if (diffy < STAT_HISTO_BINS-1) {
-              ++ stat[mm].histo[diffy];
-            } else {
-              /* last bin includes all higher values */
-              ++ stat[mm].histo[STAT_HISTO_BINS-1];
-            }
-            stat[mm].prev_jiffies = jiffy;
-          }
-        }
-      }
+  apci1710_lock(pchan->pdev, &irqstate);
 
-    } else {
-      printk("%s: %s: Error: chan=%u\n", modulename, __FUNCTION__, mm);
+  if (pchan->digoutPhase == 0) {
+    apci1710_digoutSetLocked(pchan, pchan->digoutPulse.level);
+    if (pchan->digoutPulse.width) {
+      /* trailing edge relative to the scheduled leading edge */
+      pchan->digoutPhase = 1;
+      hrtimer_forward_now(timer, ns_to_ktime(pchan->digoutPulse.width));
+      rv = HRTIMER_RESTART;
     }
+  } else {
+    apci1710_digoutSetLocked(pchan, !pchan->digoutPulse.level);
+  }
+
+  if ((rv == HRTIMER_NORESTART) && pchan->digoutPulse.repeat &&
+      (pchan->digoutPulse.trigger == APCI1710CTR_DIGOUT_AFTERLATCH)) {
+    pchan->digoutArmed = true;
   }
+
+  apci1710_unlock(pchan->pdev, irqstate);
+
+  return rv;
 }
 
 /*
- * apci1710_softReset - reset counter channel
+ * apci1710_digoutStop -
  *
- * Disable interrupts, reset ring buffer, and clear statistics
- * for one counter channel.
+ * Cancel any pending pulse and give up the EL timer module.  A pulse
+ * whose trailing edge was still to come ends now, so the output is not
+ * left at the pulse level.
+ * This routine must be called with the board lock NOT held.
  */
-static int apci1710_softReset (counter_channel_t *pchan)
+static void apci1710_digoutStop(counter_channel_t *pchan)
 {
-  if (pchan == NULL) {
-    printk("%s: %s: pchan is NULL\n", modulename, __FUNCTION__);
-  } else if (pchan->pdev == NULL) {
-    printk("%s: %s: pchan->pdev is NULL\n", modulename, __FUNCTION__);
-  } else {
-
-    apci1710_intDisable(pchan->channelIndex);
+  unsigned long irqstate;
+  int pending;
 
-    frameCountClear(pchan);
-    overflowCountClear(pchan);
-    interruptCountClear(pchan);
+  apci1710_lock(pchan->pdev, &irqstate);
+  pchan->digoutArmed = false;
+  pchan->digoutPulse.repeat = 0;
+  apci1710_unlock(pchan->pdev, irqstate);
+  pending = hrtimer_cancel(&pchan->digoutTimer);
 
-    ringbufReset(pchan);
+  apci1710_lock(pchan->pdev, &irqstate);
+  if (pending && (pchan->digoutPhase == 1)) {
+    apci1710_digoutSetLocked(pchan, !pchan->digoutPulse.level);
   }
-
-  return 0;
+  pchan->digoutPhase = 0;
+  if (pchan->elModule >= 0) {
+    (void) i_APCI1710_ELDisableTimers(pchan->pdev, pchan->elModule);
+    pchan->board->elOwner[pchan->elModule] = NULL;
+    pchan->elModule = -1;
+  }
+  apci1710_unlock(pchan->pdev, irqstate);
 }
 
-#ifdef INTENABLE_PROC
-static int apci1710_intEnable_all(void)
+/*
+ * apci1710_digoutPulse - schedule a digital output pulse
+ *
+ * Pulses triggered by a latch event use the EL timer module given in
+ * cfg->module when there is one; its delay and width are generated in
+ * hardware from the timer's trigger input, in EL_STEP_NS steps that must
+ * fit its 32-bit registers, and the module is used by one channel at a
+ * time.  Otherwise the edges are placed by an hrtimer.
+ */
+#define EL_STEP_NS    100
+
+static int apci1710_digoutPulse(counter_channel_t *pchan, counterDigoutPulse_t *cfg)
 {
-  int err6 = 1;
+  int err1 = 0, err2 = 0;
   unsigned long irqstate;
-  int moduleNumber;
+  ktime_t now;
+
+  if ((cfg->trigger > APCI1710CTR_DIGOUT_AFTERLATCH) || (cfg->level > 1) ||
+      (cfg->module < -1) || (cfg->module >= NUM_CTR_CHANNELS)) {
+    return -EINVAL;
+  }
+  if ((cfg->trigger == APCI1710CTR_DIGOUT_AFTERLATCH) && (cfg->module >= 0) &&
+      ((cfg->delay > (u64)U32_MAX * EL_STEP_NS) || (cfg->width > (u64)U32_MAX * EL_STEP_NS))) {
+    return -EINVAL;
+  }
+  if ((cfg->trigger == APCI1710CTR_DIGOUT_AFTERLATCH) && (cfg->module >= 0) &&
+      pchan->board->elOwner[cfg->module] && (pchan->board->elOwner[cfg->module] != pchan)) {
+    return -EBUSY;
+  }
 
-  if (_pdev) {
-    apci1710_lock(_pdev, &irqstate);
+  /* cancel anything pending */
+  apci1710_digoutStop(pchan);
 
-    /* Set the interrupt routine */
-    err6 = i_APCI1710_SetBoardIntRoutine (_pdev, apci1710_interrupt);
-    if (!err6) {
-      /* Enable the latch interrupt for ALL modules */
-      for (moduleNumber = 0; moduleNumber < NUM_CTR_CHANNELS; moduleNumber++) {
-        (void) i_APCI1710_EnableLatchInterrupt(_pdev, moduleNumber);
+  apci1710_lock(pchan->pdev, &irqstate);
+
+  if ((cfg->trigger == APCI1710CTR_DIGOUT_AFTERLATCH) && (cfg->module >= 0) &&
+      pchan->board->elOwner[cfg->module]) {
+    /* taken since the check above */
+    apci1710_unlock(pchan->pdev, irqstate);
+    return -EBUSY;
+  }
+
+  pchan->digoutPulse = *cfg;
+
+  switch (cfg->trigger) {
+    case APCI1710CTR_DIGOUT_ABSOLUTE:
+      now = ktime_get();
+      if (ktime_to_ns(now) >= (s64)cfg->time) {
+        apci1710_digoutStartLocked(pchan, 0);
+      } else {
+        apci1710_digoutStartLocked(pchan, cfg->time - ktime_to_ns(now));
       }
-    }
+      break;
+
+    case APCI1710CTR_DIGOUT_RELATIVE:
+      apci1710_digoutStartLocked(pchan, cfg->delay);
+      break;
+
+    case APCI1710CTR_DIGOUT_AFTERLATCH:
+      if (cfg->module >= 0) {
+        err1 = FAULT_KAPI(i_APCI1710_ELInitDelayAndPulseWidth(pchan->pdev, cfg->module,
+                                                   (uint32_t)div_u64(cfg->delay, EL_STEP_NS),
+                                                   (uint32_t)div_u64(cfg->width, EL_STEP_NS),
+                                                   cfg->level, 1));
+        if (!err1) {
+          err2 = FAULT_KAPI(i_APCI1710_ELEnableTimers(pchan->pdev, cfg->module));
+        }
+        if (!err1 && !err2) {
+          pchan->elModule = cfg->module;
+          pchan->board->elOwner[cfg->module] = pchan;
+        } else if (err1 == 3) {
+          /* not an EL timer module: fall back to the hrtimer */
+          err1 = 0;
+          pchan->digoutArmed = true;
+        }
+      } else {
+        pchan->digoutArmed = true;
+      }
+      break;
 
-    apci1710_unlock(_pdev, irqstate);
+    default:
+      break;
   }
-  return err6;
+
+  apci1710_unlock(pchan->pdev, irqstate);
+
+  if (err1) {
+    printk("%s: i_APCI1710_ELInitDelayAndPulseWidth(%d) failed (%d)\n", modulename, cfg->module, err1);
+  } else if (err2) {
+    printk("%s: i_APCI1710_ELEnableTimers(%d) failed (%d)\n", modulename, cfg->module, err2);
+  }
+
+  return (err1 || err2) ? -EFAULT : 0;
 }
-#endif /* INTENABLE_PROC */
 
-static int apci1710_intEnable(int moduleNumber)
+/* ===== scheduled digital output === ^^^ ========================= */
+
+/*
+ * apci1710_reflexLocked -
+ *
+ * Set the reflex output when a latched value moves into a new region.
+ * This routine must be called with the board lock HELD.
+ */
+static void apci1710_reflexLocked(counter_channel_t *pchan, int32_t latch)
 {
-  int err6 = 1;
-  int err7 = 0;
-  unsigned long irqstate;
+  int region;
+  uint8_t module;
 
-  if (verbose) {
-    printk("Entered apci1710_intEnable(%d)\n", moduleNumber);
+  for (region = 0; region < (int)pchan->reflex.count; region++) {
+    if (latch < pchan->reflex.threshold[region]) {
+      break;
+    }
   }
-  if (_pdev && (moduleNumber >= 0) && (moduleNumber < NUM_CTR_CHANNELS)) {
-    apci1710_lock(_pdev, &irqstate);
 
-    /* Set the interrupt routine */
-    err6 = i_APCI1710_SetBoardIntRoutine (_pdev, apci1710_interrupt);
-    if (verbose) {
-      printk("i_APCI1710_SetBoardIntRoutine() returned %d\n", err6);
-    }
-    if (!err6) {
-      /* Enable the latch interrupt */
-      err7 = i_APCI1710_EnableLatchInterrupt(_pdev, moduleNumber);
-      if (verbose) {
-        printk("i_APCI1710_EnableLatchInterrupt(%d) returned %d\n", moduleNumber, err7);
-      }
+  if (region != pchan->reflexRegion) {
+    pchan->reflexRegion = region;
+    module = (pchan->reflex.module >= 0) ? pchan->reflex.module : pchan->channelIndex;
+    if (pchan->reflex.levels & (1u << region)) {
+      (void) i_APCI1710_SetDigitalChlOn(pchan->pdev, module);
+    } else {
+      (void) i_APCI1710_SetDigitalChlOff(pchan->pdev, module);
     }
-
-    apci1710_unlock(_pdev, irqstate);
   }
-  return err6 + (1000 * err7);
 }
 
-#ifdef INTENABLE_PROC
-static int apci1710_intDisable_all(void)
+static int apci1710_reflexConfig(counter_channel_t *pchan, counterReflex_t *cfg)
 {
   unsigned long irqstate;
-  int moduleNumber;
-
-  if (_pdev) {
-    apci1710_lock(_pdev, &irqstate);
+  unsigned int ii;
 
-    /* Disable the latch interrupt for ALL modules */
-    for (moduleNumber = 0; moduleNumber < NUM_CTR_CHANNELS; moduleNumber++) {
-      (void) i_APCI1710_DisableLatchInterrupt(_pdev, moduleNumber);
+  if ((cfg->count > APCI1710CTR_REFLEX_MAX) ||
+      (cfg->module < -1) || (cfg->module >= NUM_CTR_CHANNELS) ||
+      ((cfg->module >= 0) && !pchan->board->channel[cfg->module].present)) {
+    return -EINVAL;
+  }
+  for (ii = 1; ii < cfg->count; ii++) {
+    if (cfg->threshold[ii] <= cfg->threshold[ii - 1]) {
+      return -EINVAL;
     }
-
-    apci1710_unlock(_pdev, irqstate);
   }
+
+  apci1710_lock(pchan->pdev, &irqstate);
+  pchan->reflex = *cfg;
+  pchan->reflexRegion = -1;
+  apci1710_unlock(pchan->pdev, irqstate);
+
   return 0;
 }
-#endif /* INTENABLE_PROC */
 
-static int apci1710_intDisable(int moduleNumber)
+/* ===== capture groups ========================================== */
+
+/*
+ * apci1710_groupCaptureLocked -
+ *
+ * Latch every member into its second latch register back to back, then
+ * read the latched values and push them with the shared sequence number.
+ * Only one board lock is held at a time, but interrupts stay off on this
+ * CPU throughout, so the skew is essentially the PCI write time per
+ * member.
+ * This routine must be called with the group lock HELD.
+ */
+static void apci1710_groupCaptureLocked(void)
 {
+  counter_group_t *grp = &captureGroup;
+  counterGroupStatus_t *st = &grp->status;
+  counter_channel_t *pchan;
+  int err1[APCI1710CTR_GROUP_MAX];
+  uint32_t value;
+  uint32_t timestamp;
   unsigned long irqstate;
+  unsigned int ii, members = 0;
+  ktime_t first, last;
+  u64 skew;
 
-  if (_pdev && (moduleNumber >= 0) && (moduleNumber < NUM_CTR_CHANNELS)) {
-    apci1710_lock(_pdev, &irqstate);
+  if (!grp->count) {
+    return;
+  }
+  grp->seq++;
+  timestamp = (uint32_t) ktime_to_us(ktime_get());
+
+  first = last = ktime_set(0, 0);
+  for (ii = 0; ii < grp->count; ii++) {
+    pchan = grp->member[ii];
+    apci1710_lock(pchan->pdev, &irqstate);
+    err1[ii] = FAULT_KAPI(i_APCI1710_LatchCounter(pchan->pdev, pchan->channelIndex, 1));
+    if (!err1[ii] && pchan->intEnabled) {
+      /* a software latch raises a latch interrupt too */
+      pchan->groupPending++;
+    }
+    apci1710_unlock(pchan->pdev, irqstate);
+    last = ktime_get();
+    if (ii == 0) {
+      first = last;
+    }
+  }
 
-    /* Disable the latch interrupt */
-    (void) i_APCI1710_DisableLatchInterrupt(_pdev, moduleNumber);
+  for (ii = 0; ii < grp->count; ii++) {
+    if (err1[ii]) {
+      continue;
+    }
+    pchan = grp->member[ii];
+    apci1710_lock(pchan->pdev, &irqstate);
+    if (!FAULT_KAPI(i_APCI1710_ReadLatchRegisterValue(pchan->pdev, pchan->channelIndex, 1, &value))) {
+      ringbufPushLocked(pchan, (int32_t)value, grp->seq, APCI1710CTR_FLAG_GROUP);
+      members++;
+    }
+    ctrGroupResync(&pchan->groupPending);
+    apci1710_unlock(pchan->pdev, irqstate);
+  }
 
-    apci1710_unlock(_pdev, irqstate);
+  /* report, newest first */
+  skew = ktime_to_ns(ktime_sub(last, first));
+  memmove(st->history + 1, st->history, (APCI1710CTR_GROUP_HISTORY - 1) * sizeof(st->history[0]));
+  st->history[0].seq = grp->seq;
+  st->history[0].timestamp = timestamp;
+  st->history[0].skew = (uint32_t) min_t(u64, skew, U32_MAX);
+  st->history[0].members = members;
+  if (st->count < APCI1710CTR_GROUP_HISTORY) {
+    st->count++;
+  }
+  st->captures++;
+  if (st->history[0].skew > st->maxSkew) {
+    st->maxSkew = st->history[0].skew;
   }
-  return 0;
 }
 
-static int slac_inc_counter_kernel (void)
+static enum hrtimer_restart apci1710_groupTimer(struct hrtimer *timer)
 {
-  int err1 = 0, err2 = 0, err7 = 0, err8 = 0, err9 = 0;
   unsigned long irqstate;
-  bool initFailed = false;
-  int moduleNumber;
 
-  uint8_t b_CounterRange = APCI1710_32BIT_COUNTER;        // Selection form counter range.
-  uint8_t b_FirstCounterModus;                            // First counter acquisition mode.
-  uint8_t b_FirstCounterOption;                           // First counter option.
+  spin_lock_irqsave(&captureGroup.lock, irqstate);
+  apci1710_groupCaptureLocked();
+  spin_unlock_irqrestore(&captureGroup.lock, irqstate);
 
-  if (!_pdev) {
-    printk("%s: %s: _pdev is not set\n", modulename, __FUNCTION__);
-    return 0;
-  }
+  hrtimer_forward_now(timer, ns_to_ktime(captureGroup.period));
+  return HRTIMER_RESTART;
+}
 
-  /* acquisition mode */
-  switch (mode) {
-    case 1:
-      b_FirstCounterModus = APCI1710_SIMPLE_MODE;
-      printk("%s: acquisition mode is SINGLE\n", modulename);
-      break;
-    case 2:
-      b_FirstCounterModus = APCI1710_DOUBLE_MODE;
-      printk("%s: acquisition mode is DOUBLE\n", modulename);
-      break;
-    case 4:
-    default:
-      b_FirstCounterModus = APCI1710_QUADRUPLE_MODE;
-      printk("%s: acquisition mode is QUADRUPLE\n", modulename);
-      break;
-  }
+static int apci1710_groupTrigger(void)
+{
+  unsigned long irqstate;
+  int rv = 0;
 
-  /* filter mode */
-  if (filter >= APCI1710CTR_FILTER_MIN && filter <= APCI1710CTR_FILTER_MAX) {
-    printk("%s: filter mode %d: filter from %d ns\n", modulename, filter, 100 + (50 * (filter - 1)));
-  } else if (filter == APCI1710CTR_FILTER_OFF) {
-    printk("%s: filter mode DISABLED (%d)\n", modulename, filter);
+  spin_lock_irqsave(&captureGroup.lock, irqstate);
+  if (captureGroup.count) {
+    apci1710_groupCaptureLocked();
   } else {
-    printk("%s: filter mode INVALID (%d)\n", modulename, filter);
+    rv = -EINVAL;
   }
+  spin_unlock_irqrestore(&captureGroup.lock, irqstate);
 
-  /* hysteresis mode */
-  if (hysteresis) {
-    printk("%s: hysteresis mode is ENABLED\n", modulename);
-    b_FirstCounterOption = APCI1710_HYSTERESIS_ON;
-  } else {
-    printk("%s: hysteresis mode is DISABLED\n", modulename);
-    b_FirstCounterOption = APCI1710_HYSTERESIS_OFF;
-  }
+  return rv;
+}
 
-  for (moduleNumber = 0; moduleNumber < NUM_CTR_CHANNELS; moduleNumber++) {
-    /* Lock the function to avoid parallel configurations */
-    apci1710_lock(_pdev, &irqstate);
+/*
+ * groupMembersMark -
+ *
+ * Set or clear groupMember on the current members.
+ * This routine must be called with the config lock HELD.
+ */
+static void groupMembersMark(bool member)
+{
+  counter_channel_t *pchan;
+  unsigned long irqstate;
+  unsigned int ii;
+
+  for (ii = 0; ii < captureGroup.count; ii++) {
+    pchan = captureGroup.member[ii];
+    apci1710_lock(pchan->pdev, &irqstate);
+    pchan->groupMember = member;
+    pchan->groupPending = 0;
+    apci1710_unlock(pchan->pdev, irqstate);
+  }
+}
 
-    /* Initialise the incremental counter */
-    err1 = i_APCI1710_InitCounter (_pdev,
-                        moduleNumber,
-                        b_CounterRange,
-                        b_FirstCounterModus,
-                        b_FirstCounterOption,
-                        b_FirstCounterModus,
-                        b_FirstCounterOption);
+static int apci1710_groupSet(counterGroup_t *cfg)
+{
+  counter_channel_t *member[APCI1710CTR_GROUP_MAX];
+  unsigned long irqstate;
+  unsigned int ii, jj;
 
-    if (!err1) {
-      uint32_t dump;
-      err2 = i_APCI1710_SetDigitalChlOff(_pdev, moduleNumber);
-      err7 = i_APCI1710_SetInputFilter(_pdev, moduleNumber, APCI1710_40MHZ, filter);
-      err8 = i_APCI1710_Write32BitCounterValue(_pdev, moduleNumber, 0);
-      /* read back counter in order to update latch value */
-      err9 = i_APCI1710_Read32BitCounterValue(_pdev, moduleNumber, &dump);
+  if ((cfg->count > APCI1710CTR_GROUP_MAX) ||
+      (cfg->period && (cfg->period < GROUP_MIN_PERIOD))) {
+    return -EINVAL;
+  }
+  for (ii = 0; ii < cfg->count; ii++) {
+    member[ii] = channelFromMinor(cfg->minor[ii]);
+    if (!member[ii]) {
+      return -EINVAL;
     }
-
-    /* Unlock the function so that other applications can call it */
-    apci1710_unlock(_pdev, irqstate);
-
-    if (err1) {
-      initFailed = true;
-      printk ("i_APCI1710_InitCounter(%d) failed (%d)\n", moduleNumber, err1);
+    for (jj = 0; jj < ii; jj++) {
+      if (member[jj] == member[ii]) {
+        return -EINVAL;
+      }
     }
+  }
 
-    if (err2) {
-      initFailed = true;
-      printk ("i_APCI1710_SetDigitalChlOff failed (%d)\n", err2);
-    }
+  mutex_lock(&captureGroup.configLock);
 
-    if (err7) {
-      initFailed = true;
-      printk ("i_APCI1710_SetInputFilter failed (%d)\n", err7);
-    }
+  hrtimer_cancel(&captureGroup.timer);
 
-    if (err8) {
-      initFailed = true;
-      printk ("i_APCI1710_Write32BitCounterValue failed (%d)\n", err8);
-    }
+  /* the interrupt routine decodes the latches of members only */
+  groupMembersMark(false);
 
-    if (err9) {
-      initFailed = true;
-      printk ("i_APCI1710_Read32BitCounterValue failed (%d)\n", err9);
-    }
+  spin_lock_irqsave(&captureGroup.lock, irqstate);
+  memcpy(captureGroup.member, member, cfg->count * sizeof(member[0]));
+  captureGroup.count = cfg->count;
+  captureGroup.period = cfg->period;
+  memset(&captureGroup.status, 0, sizeof(captureGroup.status));
+  spin_unlock_irqrestore(&captureGroup.lock, irqstate);
 
-    if (!initFailed) {
-      printk ("%s: Initialization of module %d successful\n", __FUNCTION__, moduleNumber);
-    }
+  groupMembersMark(true);
+
+  if (cfg->count && cfg->period) {
+    hrtimer_start(&captureGroup.timer, ns_to_ktime(cfg->period), HRTIMER_MODE_REL);
   }
 
+  mutex_unlock(&captureGroup.configLock);
+
   return 0;
 }
 
-/* ===== /proc =================================================== */
-
-static int counter_proc_show(struct seq_file *m, void *v) {
-  uint32_t value;
-  int err1 = 1;
+static void apci1710_groupStatus(counterGroupStatus_t *status)
+{
   unsigned long irqstate;
-  counter_channel_t *pchan = (counter_channel_t *)m->private;
-
-  if ((pchan == NULL) || (pchan->channelIndex > NUM_CTR_CHANNELS)) {
-    printk("%s: %s: private data error\n", modulename, __FUNCTION__);
-    return -EFAULT;
-  }
-
-  apci1710_lock(_pdev, &irqstate);
-  err1 = i_APCI1710_Read32BitCounterValue(_pdev, pchan->channelIndex, &value);
-  apci1710_unlock(_pdev, irqstate);
 
-  if (err1) {
-    value = 0;  /* default to 0 in case of error */
-    if (err1 == 3) {
-      printk("%s: %s: Counter %u not initialized\n", modulename, __FUNCTION__, pchan->channelIndex);
-    } else {
-      printk("%s: %s: Counter %u error %d\n", modulename, __FUNCTION__, pchan->channelIndex, err1);
-    }
-  }
-  seq_printf(m, "%d\n", value);
-  return 0;
+  spin_lock_irqsave(&captureGroup.lock, irqstate);
+  *status = captureGroup.status;
+  spin_unlock_irqrestore(&captureGroup.lock, irqstate);
 }
 
-static int counter_proc_open_channel0(struct inode *inode, struct  file *file) {
-  return single_open(file, counter_proc_show, &counter_channel[0]);
+static void apci1710_groupInit(void)
+{
+  spin_lock_init(&captureGroup.lock);
+  mutex_init(&captureGroup.configLock);
+  hrtimer_init(&captureGroup.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+  captureGroup.timer.function = apci1710_groupTimer;
 }
 
-static int counter_proc_open_channel1(struct inode *inode, struct  file *file) {
-  return single_open(file, counter_proc_show, &counter_channel[1]);
-}
+/* ===== capture groups === ^^^ ================================== */
 
-static int counter_proc_open_channel2(struct inode *inode, struct  file *file) {
-  return single_open(file, counter_proc_show, &counter_channel[2]);
-}
+/*
+ * apci1710_eventLocked -
+ *
+ * Queue one latch event and account it in the trigger interval histogram.
+ * Shared by the interrupt routine and the event injector.
+ * This routine must be called with the board lock HELD.
+ */
+static void apci1710_eventLocked(counter_channel_t *pchan, int32_t latch, uint32_t timestamp,
+                                 uint16_t flags, unsigned long jiffy)
+{
+  long diffy;
 
-static int counter_proc_open_channel3(struct inode *inode, struct  file *file) {
-  return single_open(file, counter_proc_show, &counter_channel[3]);
+  ringbufPushLocked(pchan, latch, timestamp, flags);
+
+  /* debug */
+  diffy = ctrStatSample(&pchan->stat, jiffy);
+  if (diffy < 0) {
+    printk("%s: %s: Error: diffy=%ld\n", modulename, __FUNCTION__, diffy);
+  }
 }
 
-static ssize_t counter_proc_write(struct file *file, const char __user *buf,  size_t count, loff_t *ppos) {
-  int val;
-  int err2 = 1;
-  struct seq_file *ss = (struct seq_file *)file->private_data;
-  counter_channel_t *pchan = NULL;
+/* ===== synthetic events ======================================== */
 
-  if (ss) {
-    pchan = (counter_channel_t *)ss->private;
-  }
+/*
+ * apci1710_injectTimer -
+ *
+ * Queue the events due since the last expiry, so that the requested rate
+ * holds when the timer runs late, from the same context as the ISR.
+ */
+static enum hrtimer_restart apci1710_injectTimer(struct hrtimer *timer)
+{
+  counter_channel_t *pchan = container_of(timer, counter_channel_t, injectTimer);
+  uint32_t timestamp = (uint32_t) ktime_to_us(ktime_get());
+  unsigned long jiffy = jiffies;
+  unsigned long irqstate;
+  u64 due;
+  bool more;
 
-  if ((pchan == NULL) || (pchan->channelIndex > NUM_CTR_CHANNELS)) {
-    printk("%s: %s: private data error\n", modulename, __FUNCTION__);
-    return -EFAULT;
-  }
+  due = hrtimer_forward_now(timer, ns_to_ktime(pchan->injectPeriod));
 
-  if (kstrtoint_from_user(buf, count, 0, &val)) {
-    return -EFAULT;
+  apci1710_lock(pchan->pdev, &irqstate);
+  while (due-- && pchan->injectRemaining) {
+    pchan->injectRemaining--;
+    interruptCountIncrement(pchan);
+    apci1710_eventLocked(pchan, (int32_t)pchan->injectValue, timestamp, APCI1710CTR_FLAG_INJECT, jiffy);
+    pchan->injectValue += pchan->injectStep;
   }
-  if (_pdev) {
-    err2 = i_APCI1710_Write32BitCounterValue(_pdev, pchan->channelIndex, (uint32_t) val);
+  more = (pchan->injectRemaining != 0);
+  apci1710_unlock(pchan->pdev, irqstate);
 
-    if (err2 == 3) {
-      printk("%s: %s: Counter %u not initialized\n", modulename, __FUNCTION__, pchan->channelIndex);
-    } else if (err2) {
-      printk("%s: %s: Counter %u error %d\n", modulename, __FUNCTION__, pchan->channelIndex, err2);
-    }
-  }
-  return count;
+  return more ? HRTIMER_RESTART : HRTIMER_NORESTART;
 }
 
-static const struct file_operations counter_proc_fops_channel0 = {
-  .owner = THIS_MODULE,
-  .open = counter_proc_open_channel0,
-  .read = seq_read,
-  .write = counter_proc_write,
-  .llseek = seq_lseek,
-  .release = single_release,
-};
+static int apci1710_inject(counter_channel_t *pchan, counterInject_t *cfg)
+{
+  unsigned long irqstate;
 
-static const struct file_operations counter_proc_fops_channel1 = {
-  .owner = THIS_MODULE,
-  .open = counter_proc_open_channel1,
-  .read = seq_read,
-  .write = counter_proc_write,
-  .llseek = seq_lseek,
-  .release = single_release,
-};
+  if (!inject || !capable(CAP_SYS_ADMIN)) {
+    return -EPERM;
+  }
+  if (cfg->count && ((cfg->rate < 1) || (cfg->rate > APCI1710CTR_INJECT_RATE_MAX))) {
+    return -EINVAL;
+  }
 
-static const struct file_operations counter_proc_fops_channel2 = {
-  .owner = THIS_MODULE,
-  .open = counter_proc_open_channel2,
-  .read = seq_read,
-  .write = counter_proc_write,
-  .llseek = seq_lseek,
-  .release = single_release,
-};
+  hrtimer_cancel(&pchan->injectTimer);
+  if (!cfg->count) {
+    return 0;
+  }
 
-static const struct file_operations counter_proc_fops_channel3 = {
-  .owner = THIS_MODULE,
-  .open = counter_proc_open_channel3,
-  .read = seq_read,
-  .write = counter_proc_write,
-  .llseek = seq_lseek,
-  .release = single_release,
-};
+  apci1710_lock(pchan->pdev, &irqstate);
+  pchan->injectPeriod = div_u64(NSEC_PER_SEC, cfg->rate);
+  pchan->injectRemaining = cfg->count;
+  pchan->injectValue = (uint32_t)cfg->counter;
+  pchan->injectStep = (uint32_t)cfg->step;
+  apci1710_unlock(pchan->pdev, irqstate);
 
-static int digout_proc_show(struct seq_file *m, void *v) {
-  seq_printf(m, "Usage:\n"
-                "echo {0|1} > digout\n"
-                "example: echo 1 > digout\n"
-                "sets value of digital output\n");
+  hrtimer_start(&pchan->injectTimer, ns_to_ktime(pchan->injectPeriod), HRTIMER_MODE_REL);
+  if (verbose) {
+    printk("%s: injecting %u events at %u/s on %u\n", modulename, cfg->count, cfg->rate, pchan->minor);
+  }
   return 0;
 }
 
-static int digout_proc_open_channel0(struct inode *inode, struct  file *file) {
-  return single_open(file, digout_proc_show, &counter_channel[0]);
-}
+/*
+ * apci1710_replayTimer -
+ *
+ * Queue the recorded events that are due, at most REPLAY_BATCH per
+ * expiry so that a recorded burst does not hold the board lock for long,
+ * then wait for the next one.  A burst longer than that goes on
+ * REPLAY_SLACK_NS later, so the expiry does not run again at once with
+ * interrupts still off.
+ */
+#define REPLAY_BATCH      256
+#define REPLAY_SLACK_NS   100000
 
-static int digout_proc_open_channel1(struct inode *inode, struct  file *file) {
-  return single_open(file, digout_proc_show, &counter_channel[1]);
+static inline ktime_t replayDueLocked(counter_channel_t *pchan)
+{
+  return ktime_add_ns(pchan->replayStart, div_u64(pchan->replayElapsed * NSEC_PER_USEC, pchan->replaySpeed));
 }
 
-static int digout_proc_open_channel2(struct inode *inode, struct  file *file) {
-  return single_open(file, digout_proc_show, &counter_channel[2]);
+static enum hrtimer_restart apci1710_replayTimer(struct hrtimer *timer)
+{
+  counter_channel_t *pchan = container_of(timer, counter_channel_t, replayTimer);
+  ktime_t now = ktime_get();
+  uint32_t timestamp = (uint32_t) ktime_to_us(now);
+  unsigned long jiffy = jiffies;
+  unsigned long irqstate;
+  const counterBuf_t *rec;
+  unsigned int nn;
+  bool more;
+
+  apci1710_lock(pchan->pdev, &irqstate);
+  for (nn = 0; (nn < REPLAY_BATCH) && (pchan->replayNext < pchan->replayCount); nn++) {
+    if (ktime_to_ns(replayDueLocked(pchan)) > ktime_to_ns(now)) {
+      break;
+    }
+    rec = pchan->replayBuf + pchan->replayNext++;
+    interruptCountIncrement(pchan);
+    apci1710_eventLocked(pchan, rec->counter, timestamp, rec->flags | APCI1710CTR_FLAG_REPLAY, jiffy);
+    if (pchan->replayNext < pchan->replayCount) {
+      pchan->replayElapsed += (uint32_t)(rec[1].timestamp - rec->timestamp);
+    }
+  }
+  more = (pchan->replayNext < pchan->replayCount);
+  if (more) {
+    if (nn == REPLAY_BATCH) {
+      hrtimer_forward_now(timer, ns_to_ktime(REPLAY_SLACK_NS));
+    } else {
+      hrtimer_set_expires(timer, replayDueLocked(pchan));
+    }
+  }
+  apci1710_unlock(pchan->pdev, irqstate);
+
+  return more ? HRTIMER_RESTART : HRTIMER_NORESTART;
 }
 
-static int digout_proc_open_channel3(struct inode *inode, struct  file *file) {
-  return single_open(file, digout_proc_show, &counter_channel[3]);
+/*
+ * apci1710_replayStop -
+ *
+ * Stop a replay and free its events.  The timer is stopped first, so
+ * nothing uses them any more.
+ */
+static void apci1710_replayStop(counter_channel_t *pchan)
+{
+  unsigned long irqstate;
+  counterBuf_t *buf;
+
+  hrtimer_cancel(&pchan->replayTimer);
+  apci1710_lock(pchan->pdev, &irqstate);
+  buf = pchan->replayBuf;
+  pchan->replayBuf = NULL;
+  pchan->replayCount = pchan->replayNext = 0;
+  apci1710_unlock(pchan->pdev, irqstate);
+  if (buf) {
+    vfree(buf);
+  }
 }
 
-static ssize_t digout_proc_write(struct file *file, const char __user *buf,  size_t count, loff_t *ppos) {
-  unsigned int val;
-  int err3 = 1;
-  struct seq_file *ss = (struct seq_file *)file->private_data;
-  counter_channel_t *pchan = NULL;
+static int apci1710_replay(counter_channel_t *pchan, counterReplay_t *cfg)
+{
   unsigned long irqstate;
+  counterBuf_t *buf;
 
-  if (ss) {
-    pchan = (counter_channel_t *)ss->private;
+  if (!inject || !capable(CAP_SYS_ADMIN)) {
+    return -EPERM;
+  }
+  if (cfg->count && ((cfg->count > APCI1710CTR_REPLAY_MAX) ||
+                     (cfg->speed < 1) || (cfg->speed > APCI1710CTR_REPLAY_SPEED_MAX))) {
+    return -EINVAL;
   }
 
-  if ((pchan == NULL) || (pchan->channelIndex > NUM_CTR_CHANNELS)) {
-    printk("%s: %s: private data error\n", modulename, __FUNCTION__);
-    return -EFAULT;
+  /* one request at a time replaces the events */
+  mutex_lock(&pchan->lock);             /* LOCK */
+  apci1710_replayStop(pchan);
+  if (!cfg->count) {
+    mutex_unlock(&pchan->lock);         /* UNLOCK */
+    return 0;
   }
 
-  if (kstrtouint_from_user(buf, count, 0, &val)) {
-    return -EFAULT;
+  buf = vmalloc(cfg->count * sizeof(counterBuf_t));
+  if (!buf) {
+    mutex_unlock(&pchan->lock);         /* UNLOCK */
+    return -ENOMEM;
   }
-  if (val > 1) {
-    return -EINVAL;
+  if (copy_from_user(buf, (const void __user *)(unsigned long)cfg->events, cfg->count * sizeof(counterBuf_t))) {
+    vfree(buf);
+    mutex_unlock(&pchan->lock);         /* UNLOCK */
+    return -EFAULT;
   }
-  if (_pdev) {
-    apci1710_lock(_pdev, &irqstate);
-    if (val) {
-      err3 = i_APCI1710_SetDigitalChlOn(_pdev, pchan->channelIndex);
-    } else {
-      err3 = i_APCI1710_SetDigitalChlOff(_pdev, pchan->channelIndex);
-    }
-    apci1710_unlock(_pdev, irqstate);
 
-    /* error check */
-    if (err3 == 3) {
-      printk("%s: %s: Counter %u not initialized\n", modulename, __FUNCTION__, pchan->channelIndex);
-    } else if (err3) {
-      printk("%s: %s: Counter %u error %d\n", modulename, __FUNCTION__, pchan->channelIndex, err3);
-    }
+  apci1710_lock(pchan->pdev, &irqstate);
+  pchan->replayBuf = buf;
+  pchan->replayCount = cfg->count;
+  pchan->replayNext = 0;
+  pchan->replaySpeed = cfg->speed;
+  pchan->replayElapsed = 0;
+  pchan->replayStart = ktime_get();
+  apci1710_unlock(pchan->pdev, irqstate);
+
+  hrtimer_start(&pchan->replayTimer, pchan->replayStart, HRTIMER_MODE_ABS);
+  mutex_unlock(&pchan->lock);           /* UNLOCK */
+  if (verbose) {
+    printk("%s: replaying %u events at %ux on %u\n", modulename, cfg->count, cfg->speed, pchan->minor);
   }
-  return count;
+  return 0;
 }
 
-static const struct file_operations digout_proc_fops_channel0 = {
-  .owner = THIS_MODULE,
-  .open = digout_proc_open_channel0,
-  .read = seq_read,
-  .write = digout_proc_write,
-  .llseek = seq_lseek,
-  .release = single_release,
-};
+/* ===== synthetic events === ^^^ ================================ */
 
-static const struct file_operations digout_proc_fops_channel1 = {
-  .owner = THIS_MODULE,
-  .open = digout_proc_open_channel1,
-  .read = seq_read,
-  .write = digout_proc_write,
-  .llseek = seq_lseek,
-  .release = single_release,
-};
+/* ===== fault injection ========================================= */
 
-static const struct file_operations digout_proc_fops_channel2 = {
-  .owner = THIS_MODULE,
-  .open = digout_proc_open_channel2,
-  .read = seq_read,
-  .write = digout_proc_write,
-  .llseek = seq_lseek,
-  .release = single_release,
-};
-
-static const struct file_operations digout_proc_fops_channel3 = {
-  .owner = THIS_MODULE,
-  .open = digout_proc_open_channel3,
-  .read = seq_read,
-  .write = digout_proc_write,
-  .llseek = seq_lseek,
-  .release = single_release,
-};
+#ifdef APCI1710CTR_DEBUG
 
-#ifdef INTENABLE_PROC
+/* across all boards */
+static atomic_t faultKapiCalls = ATOMIC_INIT(0);
+static atomic_t faultKapiFailed = ATOMIC_INIT(0);
+static atomic_t faultNomemFailed = ATOMIC_INIT(0);
+static unsigned int faultAllocs;    /* load time only */
 
-static ssize_t intEnable_proc_read(struct file *file, char __user *buf, size_t size, loff_t *ppos) {
-  static const char message[] = "Usage:\n"
-                                "echo {0|1} > intEnable\n"
-                                "example: echo 1 > intEnable\n"
-                                "enable (1) or disable (0) counter interrupts\n";
-  return simple_read_from_buffer(buf, size, ppos, message, sizeof(message));
+/*
+ * faultLatchLocked -
+ *
+ * How often to deliver the latch interrupt being handled: 0 when
+ * faultdrop drops it, 2 when faultdup duplicates it, else 1.
+ * This routine must be called with the board lock HELD.
+ */
+static int faultLatchLocked(counter_channel_t *pchan)
+{
+  pchan->faultSeq++;
+  if (faultdrop && !(pchan->faultSeq % faultdrop)) {
+    atomic_inc(&pchan->faultDropped);
+    return 0;
+  }
+  if (faultdup && !(pchan->faultSeq % faultdup)) {
+    atomic_inc(&pchan->faultDuplicated);
+    return 2;
+  }
+  return 1;
 }
 
-static ssize_t intEnable_proc_write(struct file *file, const char __user *buf,  size_t count, loff_t *ppos) {
-  unsigned int val;
-  if (kstrtouint_from_user(buf, count, 0, &val)) {
-    return -EFAULT;
-  }
-  if (val > 1) {
-    return -EINVAL;
+/*
+ * faultWakeDelayLocked -
+ *
+ * With faultdelay, leave the wakeup after a push to
+ * apci1710_faultWakeTimer, which wakes readers once for every push since
+ * it was started.
+ * This routine must be called with the board lock HELD.
+ */
+static bool faultWakeDelayLocked(counter_channel_t *pchan)
+{
+  if (!faultdelay) {
+    return false;
   }
-  if (val) {
-    apci1710_intEnable_all();
-  } else {
-    apci1710_intDisable_all();
+  if (!hrtimer_is_queued(&pchan->faultWakeTimer)) {
+    hrtimer_start(&pchan->faultWakeTimer, ns_to_ktime((u64)faultdelay * NSEC_PER_USEC), HRTIMER_MODE_REL);
   }
-
-  return count;
+  atomic_inc(&pchan->faultDelayed);
+  return true;
 }
 
-static const struct file_operations intEnable_proc_fops = {
-  .owner = THIS_MODULE,
-  .read = intEnable_proc_read,
-  .write = intEnable_proc_write,
-  .llseek = default_llseek,
-};
+static enum hrtimer_restart apci1710_faultWakeTimer(struct hrtimer *timer)
+{
+  counter_channel_t *pchan = container_of(timer, counter_channel_t, faultWakeTimer);
+  unsigned long irqstate;
 
-#endif /* INTENABLE_PROC */
+  apci1710_lock(pchan->pdev, &irqstate);
+  wake_up_interruptible(&pchan->inq);
+  if (pchan->readyArmed) {
+    pchan->readyArmed = false;
+    notifyLocked(pchan, POLL_IN);
+  }
+  apci1710_unlock(pchan->pdev, irqstate);
 
-static ssize_t statCtrl_proc_read(struct file *file, char __user *buf, size_t size, loff_t *ppos) {
-  static const char message[] = "Usage:\n"
-                                "echo 0 > statCtrl\n"
-                                "  stop collecting statistics\n"
-                                "echo 1 > statCtrl\n"
-                                "  start collecting statistics\n"
-                                "echo 2 > statCtrl\n"
-                                "  reset statistics\n"
-                                "echo 3 > statCtrl\n"
-                                "  start ignoring trigger intervals under 8ms\n"
-                                "echo 4 > statCtrl\n"
-                                "  stop ignoring trigger intervals under 8ms\n";
-  return simple_read_from_buffer(buf, size, ppos, message, sizeof(message));
+  return HRTIMER_NORESTART;
 }
 
-static ssize_t statCtrl_proc_write(struct file *file, const char __user *buf,  size_t count, loff_t *ppos) {
-  unsigned int val;
-  ssize_t rv;
+static void *faultKmalloc(size_t size, gfp_t flags)
+{
+  if (faultnomem && (++faultAllocs == faultnomem)) {
+    atomic_inc(&faultNomemFailed);
+    return NULL;
+  }
+  return kmalloc(size, flags);
+}
 
-  if (kstrtouint_from_user(buf, count, 0, &val)) {
-    return -EFAULT;
-  } else {
-    rv = count;
+/* true when the kAPI call at hand is to fail instead of being made */
+static bool faultKapi(void)
+{
+  if (!faultkapi || ((unsigned int)atomic_inc_return(&faultKapiCalls) % faultkapi)) {
+    return false;
   }
-  switch (val) {
-    case 0: statStop(STAT_CHANNEL);                     break;
-    case 1: statStart(STAT_CHANNEL);                    break;
-    case 2: statReset(STAT_CHANNEL);                    break;
-    case 3: stat[STAT_CHANNEL].ignoreEnabled = true;    break;
-    case 4: stat[STAT_CHANNEL].ignoreEnabled = false;   break;
-    default: rv = -EINVAL;                              break;
+  atomic_inc(&faultKapiFailed);
+  return true;
+}
+
+static int faults_proc_show(struct seq_file *m, void *v)
+{
+  counter_channel_t *pchan;
+  unsigned int bb;
+  int ii;
+
+  seq_printf(m, "faultdrop=%u faultdup=%u faultdelay=%u faultnomem=%u faultkapi=%u\n",
+             faultdrop, faultdup, faultdelay, faultnomem, faultkapi);
+  seq_printf(m, "Ring allocations failed: %d\n", atomic_read(&faultNomemFailed));
+  seq_printf(m, "kAPI calls failed:       %d\n", atomic_read(&faultKapiFailed));
+  seq_printf(m, "minor  dropped  duplicated  delayed\n");
+  for (bb = 0; bb < numBoards; bb++) {
+    for (ii = 0; ii < NUM_CTR_CHANNELS; ii++) {
+      pchan = boards[bb]->channel + ii;
+      if (pchan->present) {
+        seq_printf(m, "%5u  %7d  %10d  %7d\n", pchan->minor, atomic_read(&pchan->faultDropped),
+                   atomic_read(&pchan->faultDuplicated), atomic_read(&pchan->faultDelayed));
+      }
+    }
   }
-  return rv;
+  return 0;
 }
 
-static const struct file_operations statCtrl_proc_fops = {
+static int faults_proc_open(struct inode *inode, struct file *file)
+{
+  return single_open(file, faults_proc_show, NULL);
+}
+
+static const struct file_operations faults_proc_fops = {
   .owner = THIS_MODULE,
-  .read = statCtrl_proc_read,
-  .write = statCtrl_proc_write,
-  .llseek = default_llseek,
+  .open = faults_proc_open,
+  .read = seq_read,
+  .llseek = seq_lseek,
+  .release = single_release,
 };
 
-static int status_proc_show(struct seq_file *m, void *v) {
-  int ii;
-  unsigned long irqstate;
-  uint8_t status1;
-  uint32_t value2;
-  int err1, err2;
-  counter_channel_t *pchan = (counter_channel_t *)m->private;
+#endif /* APCI1710CTR_DEBUG */
 
-  if ((pchan == NULL) || (pchan->channelIndex > NUM_CTR_CHANNELS)) {
-    printk("%s: %s: private data error\n", modulename, __FUNCTION__);
-    return -EFAULT;
+/* ===== fault injection === ^^^ ================================= */
+
+/*
+ * chronoTimestampLocked -
+ *
+ * Advance the channel's board-clocked time by the period the paired
+ * chronometer measured since the previous trigger (status 2, measurement
+ * stopped) and return it in *timestamp, in microseconds like the CPU
+ * timestamp.  Without such a period (first trigger, overflow, read
+ * error), or when it disagrees with the CPU clock by more than
+ * CHRONO_SLACK_NS plus CHRONO_SLACK_PPM, which means a trigger was
+ * missed, the time starts over from the CPU time and it returns false.
+ * This routine must be called with the board lock HELD.
+ */
+#define CHRONO_SLACK_NS   1000000
+#define CHRONO_SLACK_PPM  1000
+
+static bool chronoTimestampLocked(counter_channel_t *pchan, ktime_t now, uint32_t *timestamp)
+{
+  u64 cpuNs = ktime_to_ns(now);
+  u64 periodNs = 0, cpuPeriodNs;
+  uint8_t status;
+  uint32_t value;
+  bool ok;
+
+  ok = !FAULT_KAPI(i_APCI1710_ReadChronoValue(pchan->pdev, pchan->chronoModule, 0, &status, &value)) &&
+       (status == 2) && pchan->chronoCpuNs;
+  if (ok) {
+    periodNs = value * pchan->chronoUnitNs;
+    cpuPeriodNs = cpuNs - pchan->chronoCpuNs;
+    ok = (max(periodNs, cpuPeriodNs) - min(periodNs, cpuPeriodNs) <=
+          CHRONO_SLACK_NS + div_u64(cpuPeriodNs, 1000000 / CHRONO_SLACK_PPM));
   }
+  pchan->chronoTimeNs = ok ? pchan->chronoTimeNs + periodNs : cpuNs;
+  pchan->chronoCpuNs = cpuNs;
+  *timestamp = (uint32_t) div_u64(pchan->chronoTimeNs, NSEC_PER_USEC);
+  return ok;
+}
 
-  if (_pdev) {
-    /* Lock the function to avoid parallel configurations */
-    apci1710_lock(_pdev, &irqstate);
+/* ctrLatchStatusFn for ctrGroupDecode(), ctx is the channel */
+static int latchStatusRead(void *ctx, uint8_t reg, uint8_t *status)
+{
+  counter_channel_t *pchan = ctx;
 
-    err1 = i_APCI1710_ReadLatchRegisterStatus(_pdev, pchan->channelIndex, 0, &status1);
-    err2 = i_APCI1710_ReadLatchRegisterValue(_pdev, pchan->channelIndex, 0, &value2);
+  return FAULT_KAPI(i_APCI1710_ReadLatchRegisterStatus(pchan->pdev, pchan->channelIndex, reg, status));
+}
 
-    /* Unlock the function so that other applications can call it */
-    apci1710_unlock(_pdev, irqstate);
+static void apci1710_interrupt (struct pci_dev * pdev)
+{
+  uint8_t   mm;
+  uint32_t  im;
+  int32_t   latch;
+  uint32_t  timestamp;
+  uint16_t  flags = 0;
+  ktime_t   now;
+  int       deliver;
+  counter_channel_t *pchan;
+  counter_board_t *board;
+  unsigned long jiffy = jiffies;    /* kernel tick count */
 
-    if (err1 == 3) {
-      seq_printf(m, "Counter not initialized\n");
-      return 0;
-    }
+  /* take the software timestamp before any PCI access */
+  now = ktime_get();
+  timestamp = (uint32_t) ktime_to_us(now);
 
-    if (!err1 && !err2) {
-      seq_printf(m, "ReadLatchRegisterStatus: 0x%08x (%u)\n", status1, status1);
-      seq_printf(m, "ReadLatchRegisterValue:  %d (%u)\n", value2,  value2);
-    } else {
-      seq_printf(m, "ReadLatchRegisterStatus: 0x%08x (%u) (err=%d)\n", status1, status1, err1);
-      seq_printf(m, "ReadLatchRegisterValue:  %d (%u) (err=%d)\n", value2,  value2, err2);
-    }
-    seq_printf(m, "Interrupt count:  %d\n", interruptCountGet(counter_channel + pchan->channelIndex));
-    seq_printf(m, "Frame count:      %d\n", frameCountGet(counter_channel + pchan->channelIndex));
-    seq_printf(m, "Overflow count:   %d\n", overflowCountGet(counter_channel + pchan->channelIndex));
-    seq_printf(m, "Buffer level:     %u / %u\n", ringbufLevel(counter_channel + pchan->channelIndex), _ringSize - 1);
-    seq_printf(m, "Acquisition mode: %d: ", mode);
-    switch (mode) {
-      case 1: seq_printf(m, "Single"); break;
-      case 2: seq_printf(m, "Double"); break;
-      case 4: seq_printf(m, "Quadruple"); break;
-      default: seq_printf(m, "INVALID"); break;
-    }
-    seq_printf(m, "\n");
-    seq_printf(m, "Digital filter:  %2d: ", filter);
-    if (filter >= APCI1710CTR_FILTER_MIN && filter <= APCI1710CTR_FILTER_MAX) {
-      seq_printf(m, "Filter from %dns", 100 + (50 * (filter - 1)));
-    } else if (filter == APCI1710CTR_FILTER_OFF) {
-      seq_printf(m, "Filter not used");
-    } else {
-      seq_printf(m, "INVALID");
-    }
-    seq_printf(m, "\nHysteresis mode:  %s\n", hysteresis ? "ENABLED" : "DISABLED");
+  /* each board has its own callback invocation and lock */
+  board = boardFromPdev(pdev);
 
-    if (pchan->channelIndex == STAT_CHANNEL) {
-      seq_printf(m, "--- trigger interval (ms) ---\n");
-    
-      for (ii = 0; ii < STAT_HISTO_BINS-1; ii++) {
-        seq_printf(m, "  %2d  : %-7d\n", ii, stat[pchan->channelIndex].histo[ii]);
+  if (board) {
+    (void) i_APCI1710_TestInterrupt(pdev, &mm, &im, (uint32_t *)&latch);
+    if ((mm < NUM_CTR_CHANNELS) && board->pulseEncOwner[mm]) {
+      /* pulse encoder run-down, reported to the channel driving it */
+      pchan = board->pulseEncOwner[mm];
+      interruptCountIncrement(pchan);
+      ringbufPushLocked(pchan, (int32_t)im, timestamp, APCI1710CTR_FLAG_PULSEENC);
+    } else if ((mm < NUM_CTR_CHANNELS) && board->channel[mm].present) {
+      pchan = board->channel + mm;
+
+      /* capture group software latch, already pushed by the group */
+      if (pchan->groupMember && ctrGroupDecode(&pchan->groupPending, latchStatusRead, pchan)) {
+        interruptCountIncrement(pchan);
+        return;
       }
-      seq_printf(m, "  %2d+ : %-7d\n", ii, stat[pchan->channelIndex].histo[ii]);
-      if (stat[pchan->channelIndex].ignoreEnabled) {
-        seq_printf(m, "ignored : %-7lu (interval less than 8ms)\n", stat[pchan->channelIndex].ignoreCount);
-      } else {
-        seq_printf(m, "ignoreEnabled is not set\n");
+
+      /*
+       * callback already holds spinlock; a dropped interrupt is counted
+       * as a fault only, as if it had never arrived
+       */
+      deliver = faultLatchLocked(pchan);
+      if (!deliver) {
+        return;
+      }
+      interruptCountIncrement(pchan);
+
+      /* with a paired chronometer, board-clocked time */
+      if ((pchan->chronoModule >= 0) && chronoTimestampLocked(pchan, now, &timestamp)) {
+        flags |= APCI1710CTR_FLAG_CHRONO;
       }
+
+      apci1710_eventLocked(pchan, latch, timestamp, flags, jiffy);
+      if (deliver > 1) {
+        apci1710_eventLocked(pchan, latch, timestamp, flags, jiffy);
+      }
+
+      /* threshold reflex, in the same lock hold */
+      if (pchan->reflex.count) {
+        apci1710_reflexLocked(pchan, latch);
+      }
+
+      /* pulse scheduled on this latch event */
+      if (pchan->digoutArmed) {
+        pchan->digoutArmed = false;
+        apci1710_digoutStartLocked(pchan, pchan->digoutPulse.delay);
+      }
+
+    } else {
+      /* TestInterrupt reported a module that has no channel or owner */
+      CTR_CHECK(false);
+      printk("%s: %s: Error: board=%u chan=%u\n", modulename, __FUNCTION__, board->boardIndex, mm);
     }
+  }
+}
 
-  } else {
-    seq_printf(m, "lookupboard_by_index(0) failed\n");
+/*
+ * apci1710_statsGet -
+ *
+ * Fill in the binary statistics for one channel.  Only driver state is
+ * read, without the board lock, so values may be a few events apart.
+ */
+static void apci1710_statsGet(counter_channel_t *pchan, counterStatsChannel_t *st)
+{
+  ctrRing_t ring = pchan->ring;
+  int ii;
+
+  memset(st, 0, sizeof(*st));
+  st->minor = pchan->minor;
+  if (pchan->intEnabled) {
+    st->flags |= APCI1710CTR_STATS_INTENABLED;
+  }
+  if (pchan->stat.histoEnabled) {
+    st->flags |= APCI1710CTR_STATS_HISTOENABLED;
+  }
+  if (pchan->stat.ignoreEnabled) {
+    st->flags |= APCI1710CTR_STATS_IGNOREENABLED;
+  }
+  st->interruptCount = interruptCountGet(pchan);
+  st->frameCount = frameCountGet(pchan);
+  st->overflowCount = overflowCountGet(pchan);
+  st->ringSize = ring.size;
+  st->ringLevel = ctrRingLevel(&ring);
+  st->ringHighWater = ring.highWater;
+  st->mode = mode;
+  st->hysteresis = hysteresis;
+  st->filter = filter;
+  st->chronoModule = pchan->chronoModule;
+  st->pulseEncModule = pchan->pulseEncModule;
+  st->elModule = pchan->elModule;
+  st->reflexCount = pchan->reflex.count;
+  st->reflexRegion = pchan->reflexRegion;
+  st->ignoreCount = pchan->stat.ignoreCount;
+  for (ii = 0; ii < STAT_HISTO_BINS; ii++) {
+    st->histo[ii] = pchan->stat.histo[ii];
+  }
+}
+
+/*
+ * exceptionRaiseLocked -
+ *
+ * Flag a condition for poll() and APCI1710CTR_IOCGETEXCEPTIONS on every
+ * fd that asked for exceptions, except origin, the fd that caused it
+ * (NULL = none).  Returns true when a bit was newly set somewhere, so
+ * that the caller wakes the pollers.
+ * This routine must be called with the board lock HELD.
+ */
+static bool exceptionRaiseLocked(counter_channel_t *pchan, unsigned int bits, counter_file_t *origin)
+{
+  counter_file_t *cf;
+  bool rv = false;
+
+  list_for_each_entry(cf, &pchan->files, node) {
+    if (cf->exceptionsOn && (cf != origin) && (~cf->exceptions & bits)) {
+      cf->exceptions |= bits;
+      rv = true;
+    }
+  }
+  return rv;
+}
+
+/* as exceptionRaiseLocked(), with the board lock NOT held */
+static void exceptionRaise(counter_channel_t *pchan, unsigned int bits, counter_file_t *origin)
+{
+  unsigned long irqstate;
+  bool wake;
+
+  apci1710_lock(pchan->pdev, &irqstate);
+  wake = exceptionRaiseLocked(pchan, bits, origin);
+  apci1710_unlock(pchan->pdev, irqstate);
+
+  if (wake) {
+    wake_up_interruptible(&pchan->inq);
   }
-  return 0;
 }
 
-static int status_proc_open_channel0(struct inode *inode, struct  file *file) {
-  return single_open(file, status_proc_show, &counter_channel[0]);
+/* the fd's exceptions since the last call, which turns them on */
+static unsigned int exceptionFetch(counter_file_t *cf)
+{
+  counter_channel_t *pchan = cf->pchan;
+  unsigned long irqstate;
+  unsigned int rv;
+
+  apci1710_lock(pchan->pdev, &irqstate);
+  cf->exceptionsOn = true;
+  rv = cf->exceptions;
+  cf->exceptions = 0;
+  apci1710_unlock(pchan->pdev, irqstate);
+
+  return rv;
 }
 
-static int status_proc_open_channel1(struct inode *inode, struct  file *file) {
-  return single_open(file, status_proc_show, &counter_channel[1]);
+/*
+ * apci1710_softReset - reset counter channel
+ *
+ * Disable interrupts, reset ring buffer, and clear statistics
+ * for one counter channel.  origin is the fd asking for it, if any.
+ */
+static int apci1710_softReset (counter_channel_t *pchan, counter_file_t *origin)
+{
+  if (pchan == NULL) {
+    printk("%s: %s: pchan is NULL\n", modulename, __FUNCTION__);
+  } else if (pchan->pdev == NULL) {
+    printk("%s: %s: pchan->pdev is NULL\n", modulename, __FUNCTION__);
+  } else {
+
+    apci1710_intDisable(pchan, origin);
+    hrtimer_cancel(&pchan->injectTimer);
+    apci1710_replayStop(pchan);
+
+    ringbufReset(pchan);
+    exceptionRaise(pchan, APCI1710CTR_EXC_RESET, origin);
+  }
+
+  return 0;
 }
 
-static int status_proc_open_channel2(struct inode *inode, struct  file *file) {
-  return single_open(file, status_proc_show, &counter_channel[2]);
+#ifdef INTENABLE_PROC
+static int apci1710_intEnable_all(counter_board_t *board)
+{
+  int err6 = 1;
+  unsigned long irqstate;
+  int moduleNumber;
+
+  apci1710_lock(board->pdev, &irqstate);
+
+  /* Set the interrupt routine */
+  err6 = FAULT_KAPI(i_APCI1710_SetBoardIntRoutine (board->pdev, apci1710_interrupt));
+  if (!err6) {
+    /* Enable the latch interrupt for ALL modules */
+    for (moduleNumber = 0; moduleNumber < NUM_CTR_CHANNELS; moduleNumber++) {
+      if (board->channel[moduleNumber].present) {
+        if (!FAULT_KAPI(i_APCI1710_EnableLatchInterrupt(board->pdev, moduleNumber))) {
+          board->channel[moduleNumber].intEnabled = true;
+        }
+      }
+    }
+  }
+
+  apci1710_unlock(board->pdev, irqstate);
+  return err6;
 }
+#endif /* INTENABLE_PROC */
+
+static int apci1710_intEnable(counter_channel_t *pchan)
+{
+  int err6 = 1;
+  int err7 = 0;
+  unsigned long irqstate;
+  int moduleNumber = pchan->channelIndex;
+
+  if (verbose) {
+    printk("Entered apci1710_intEnable(%u)\n", pchan->minor);
+  }
+  if (pchan->pdev && pchan->present) {
+    apci1710_lock(pchan->pdev, &irqstate);
+
+    /* Set the interrupt routine */
+    err6 = FAULT_KAPI(i_APCI1710_SetBoardIntRoutine (pchan->pdev, apci1710_interrupt));
+    if (verbose) {
+      printk("i_APCI1710_SetBoardIntRoutine() returned %d\n", err6);
+    }
+    if (!err6) {
+      /* Enable the latch interrupt */
+      err7 = FAULT_KAPI(i_APCI1710_EnableLatchInterrupt(pchan->pdev, moduleNumber));
+      pchan->intEnabled = !err7;
+      if (verbose) {
+        printk("i_APCI1710_EnableLatchInterrupt(%d) returned %d\n", moduleNumber, err7);
+      }
+    }
+
+    apci1710_unlock(pchan->pdev, irqstate);
+  }
+  return err6 + (1000 * err7);
+}
+
+#ifdef INTENABLE_PROC
+static int apci1710_intDisable_all(counter_board_t *board)
+{
+  unsigned long irqstate;
+  int moduleNumber;
+
+  apci1710_lock(board->pdev, &irqstate);
+
+  /* Disable the latch interrupt for ALL modules */
+  for (moduleNumber = 0; moduleNumber < NUM_CTR_CHANNELS; moduleNumber++) {
+    if (board->channel[moduleNumber].present) {
+      (void) i_APCI1710_DisableLatchInterrupt(board->pdev, moduleNumber);
+      board->channel[moduleNumber].intEnabled = false;
+      board->channel[moduleNumber].groupPending = 0;
+      (void) exceptionRaiseLocked(board->channel + moduleNumber, APCI1710CTR_EXC_INTDISABLED, NULL);
+    }
+  }
+
+  apci1710_unlock(board->pdev, irqstate);
+
+  for (moduleNumber = 0; moduleNumber < NUM_CTR_CHANNELS; moduleNumber++) {
+    wake_up_interruptible(&board->channel[moduleNumber].inq);
+  }
+  return 0;
+}
+#endif /* INTENABLE_PROC */
+
+static int apci1710_intDisable(counter_channel_t *pchan, counter_file_t *origin)
+{
+  unsigned long irqstate;
+  bool wake;
+
+  if (pchan->pdev && pchan->present) {
+    apci1710_lock(pchan->pdev, &irqstate);
+
+    /* Disable the latch interrupt */
+    (void) i_APCI1710_DisableLatchInterrupt(pchan->pdev, pchan->channelIndex);
+    pchan->intEnabled = false;
+    pchan->groupPending = 0;
+    wake = exceptionRaiseLocked(pchan, APCI1710CTR_EXC_INTDISABLED, origin);
+
+    apci1710_unlock(pchan->pdev, irqstate);
+    if (wake) {
+      wake_up_interruptible(&pchan->inq);
+    }
+  }
+  return 0;
+}
+
+/*
+ * chronoReleaseLocked -
+ *
+ * Disable the channel's chronometer, if any, and give up the module.
+ * This routine must be called with the board lock HELD.
+ */
+static void chronoReleaseLocked(counter_channel_t *pchan)
+{
+  if (pchan->chronoModule >= 0) {
+    (void) i_APCI1710_DisableChrono(pchan->pdev, pchan->chronoModule);
+    pchan->board->chronoOwner[pchan->chronoModule] = NULL;
+    pchan->chronoModule = -1;
+  }
+}
+
+/*
+ * apci1710_chronoPair - pair a counter channel with a chronometer module
+ *
+ * The chronometer measures the time between edges on its own input, so
+ * that input must be wired to the same signal as the latch trigger of the
+ * counter and chronoMode must be a period mode (0 or 1): each trigger then
+ * stops one measurement and, in APCI1710_CONTINUOUS, starts the next.  Its
+ * own interrupt stays disabled so that apci1710_interrupt() can read the
+ * finished measurement directly on each latch event.  A module is paired
+ * with one channel at a time.
+ * A module number of -1 unpairs the channel.
+ */
+static int apci1710_chronoPair(counter_channel_t *pchan, counterChrono_t *cfg)
+{
+  static const u64 unitNs[] = { 1, NSEC_PER_USEC, NSEC_PER_MSEC, NSEC_PER_SEC, 60 * NSEC_PER_SEC };
+  int err1 = 0, err2 = 0;
+  unsigned long irqstate;
+
+  /* a count of under 2^32 ns keeps count times unit within 64 bits */
+  if ((cfg->module < -1) || (cfg->module >= NUM_CTR_CHANNELS) ||
+      ((cfg->module >= 0) && (pchan->board->moduleFunctionality[cfg->module] != APCI1710_CHRONOMETER)) ||
+      ((cfg->module >= 0) && ((cfg->timingUnit >= ARRAY_SIZE(unitNs)) ||
+                              (cfg->timingInterval > div64_u64(0xffffffffULL, unitNs[cfg->timingUnit]))))) {
+    return -EINVAL;
+  }
+
+  apci1710_lock(pchan->pdev, &irqstate);
+
+  if ((cfg->module >= 0) && pchan->board->chronoOwner[cfg->module] &&
+      (pchan->board->chronoOwner[cfg->module] != pchan)) {
+    apci1710_unlock(pchan->pdev, irqstate);
+    return -EBUSY;
+  }
+
+  /* release the previous chronometer */
+  chronoReleaseLocked(pchan);
+
+  if (cfg->module >= 0) {
+    err1 = FAULT_KAPI(i_APCI1710_InitChrono(pchan->pdev, cfg->module, cfg->chronoMode,
+                                 APCI1710_40MHZ, cfg->timingUnit, cfg->timingInterval));
+    if (!err1) {
+      err2 = FAULT_KAPI(i_APCI1710_EnableChrono(pchan->pdev, cfg->module, APCI1710_CONTINUOUS, APCI1710_DISABLE));
+    }
+    if (!err1 && !err2) {
+      pchan->chronoModule = cfg->module;
+      pchan->chronoUnitNs = unitNs[cfg->timingUnit] * cfg->timingInterval;
+      pchan->chronoCpuNs = 0;
+      pchan->board->chronoOwner[cfg->module] = pchan;
+    }
+  }
+
+  apci1710_unlock(pchan->pdev, irqstate);
+
+  if (err1) {
+    printk("%s: i_APCI1710_InitChrono(%d) failed (%d)\n", modulename, cfg->module, err1);
+  } else if (err2) {
+    printk("%s: i_APCI1710_EnableChrono(%d) failed (%d)\n", modulename, cfg->module, err2);
+  }
+
+  return (err1 || err2) ? -EFAULT : 0;
+}
+
+/*
+ * apci1710_pulseEncConfig - drive a pulse encoder from a counter channel
+ *
+ * Configure and enable one pulse encoder.  Run-down interrupts, if
+ * requested, are pushed into the ring of the configuring channel.
+ * A module number of -1 disables the channel's pulse encoder.
+ */
+static int apci1710_pulseEncConfig(counter_channel_t *pchan, counterPulseEnc_t *cfg)
+{
+  int err1 = 0, err2 = 0, err6 = 0;
+  unsigned long irqstate;
+
+  if ((cfg->module < -1) || (cfg->module >= NUM_CTR_CHANNELS) || (cfg->encoder > 3) ||
+      ((cfg->module >= 0) && (pchan->board->moduleFunctionality[cfg->module] != APCI1710_PULSE_ENCODER))) {
+    return -EINVAL;
+  }
+
+  apci1710_lock(pchan->pdev, &irqstate);
+
+  if ((cfg->module >= 0) && pchan->board->pulseEncOwner[cfg->module] &&
+      (pchan->board->pulseEncOwner[cfg->module] != pchan)) {
+    apci1710_unlock(pchan->pdev, irqstate);
+    return -EBUSY;
+  }
+
+  /* release the previous pulse encoder */
+  if (pchan->pulseEncModule >= 0) {
+    (void) i_APCI1710_DisablePulseEncoder(pchan->pdev, pchan->pulseEncModule, pchan->pulseEncoder);
+    pchan->board->pulseEncOwner[pchan->pulseEncModule] = NULL;
+    pchan->pulseEncModule = -1;
+  }
+
+  if (cfg->module >= 0) {
+    if (cfg->interrupt) {
+      /* run-down interrupts require the interrupt routine */
+      err6 = FAULT_KAPI(i_APCI1710_SetBoardIntRoutine(pchan->pdev, apci1710_interrupt));
+    }
+    if (!err6) {
+      err1 = FAULT_KAPI(i_APCI1710_InitPulseEncoder(pchan->pdev, cfg->module, cfg->encoder,
+                                         cfg->inputLevel, cfg->triggerAction, cfg->startValue));
+    }
+    if (!err6 && !err1) {
+      err2 = FAULT_KAPI(i_APCI1710_EnablePulseEncoder(pchan->pdev, cfg->module, cfg->encoder,
+                                           cfg->continuous ? APCI1710_CONTINUOUS : APCI1710_SINGLE,
+                                           cfg->interrupt ? APCI1710_ENABLE : APCI1710_DISABLE));
+    }
+    if (!err6 && !err1 && !err2) {
+      pchan->pulseEncModule = cfg->module;
+      pchan->pulseEncoder = cfg->encoder;
+      pchan->board->pulseEncOwner[cfg->module] = pchan;
+    }
+  }
+
+  apci1710_unlock(pchan->pdev, irqstate);
+
+  if (err6) {
+    printk("%s: i_APCI1710_SetBoardIntRoutine() failed (%d)\n", modulename, err6);
+  } else if (err1) {
+    printk("%s: i_APCI1710_InitPulseEncoder(%d, %u) failed (%d)\n", modulename, cfg->module, cfg->encoder, err1);
+  } else if (err2) {
+    printk("%s: i_APCI1710_EnablePulseEncoder(%d, %u) failed (%d)\n", modulename, cfg->module, cfg->encoder, err2);
+  }
+
+  return (err6 || err1 || err2) ? -EFAULT : 0;
+}
+
+static int apci1710_pulseEncWrite(counter_channel_t *pchan, uint32_t value)
+{
+  int err1 = 1;
+  unsigned long irqstate;
+
+  if (pchan->pulseEncModule < 0) {
+    return -EINVAL;
+  }
+
+  apci1710_lock(pchan->pdev, &irqstate);
+  if (pchan->pulseEncModule >= 0) {
+    err1 = FAULT_KAPI(i_APCI1710_WritePulseEncoderValue(pchan->pdev, pchan->pulseEncModule, pchan->pulseEncoder, value));
+  }
+  apci1710_unlock(pchan->pdev, irqstate);
+
+  return err1 ? -EFAULT : 0;
+}
+
+static int apci1710_pulseEncStatus(counter_channel_t *pchan, counterPulseEncStatus_t *status)
+{
+  int err1 = 1, err2 = 1;
+  uint8_t overflow = 0;
+  uint32_t value = 0;
+  unsigned long irqstate;
+
+  if (pchan->pulseEncModule < 0) {
+    return -EINVAL;
+  }
+
+  apci1710_lock(pchan->pdev, &irqstate);
+  if (pchan->pulseEncModule >= 0) {
+    err1 = FAULT_KAPI(i_APCI1710_ReadPulseEncoderStatus(pchan->pdev, pchan->pulseEncModule, pchan->pulseEncoder, &overflow));
+    err2 = FAULT_KAPI(i_APCI1710_ReadPulseEncoderValue(pchan->pdev, pchan->pulseEncModule, pchan->pulseEncoder, &value));
+  }
+  apci1710_unlock(pchan->pdev, irqstate);
+
+  status->value = value;
+  status->overflow = overflow;
+
+  return (err1 || err2) ? -EFAULT : 0;
+}
+
+static const char *functionalityName(uint32_t functionality)
+{
+  switch (functionality) {
+    case APCI1710_INCREMENTAL_COUNTER:  return "incremental counter";
+    case APCI1710_SSI_COUNTER:          return "SSI counter";
+    case APCI1710_TTL_IO:               return "TTL I/O";
+    case APCI1710_DIGITAL_IO:           return "digital I/O";
+    case APCI1710_82X54_TIMER:          return "82X54 timer";
+    case APCI1710_CHRONOMETER:          return "chronometer";
+    case APCI1710_PULSE_ENCODER:        return "pulse encoder";
+    case APCI1710_TOR_COUNTER:          return "TOR counter";
+    case APCI1710_PWM:                  return "PWM";
+    case APCI1710_ETM:                  return "ETM";
+    case APCI1710_CDA:                  return "CDA";
+    case APCI1710_SPEEDBOX:             return "speedbox";
+    case APCI1710_BISS_MASTER:          return "BiSS master";
+    case APCI1710_PTP:                  return "PTP";
+    case PCIE1711_ENDAT:                return "EnDat";
+    case APCI1710_IDV:                  return "IDV";
+    case APCI1710_BALISE:               return "balise";
+    case APCI1710_EL_TIMERS:            return "EL timers";
+    default:                            return "unknown";
+  }
+}
+
+/*
+ * apci1710_probeModules - detect the module in each slot
+ *
+ * Only slots holding an incremental counter get a counter channel.
+ */
+static int apci1710_probeModules (counter_board_t *board)
+{
+  int err1, err2 = 0, err3 = 0;
+  unsigned long irqstate;
+  int moduleNumber;
+
+  apci1710_lock(board->pdev, &irqstate);
+
+  err1 = i_APCI1710_ReadModulesConfiguration(board->pdev);
+  for (moduleNumber = 0; !err1 && (moduleNumber < NUM_CTR_CHANNELS); moduleNumber++) {
+    board->moduleId[moduleNumber] = 0;
+    board->moduleFunctionality[moduleNumber] = 0;
+    err2 = i_APCI1710_GetModuleId(board->pdev, moduleNumber, &board->moduleId[moduleNumber]);
+    err3 = i_APCI1710_GetFunctionality(board->pdev, moduleNumber, &board->moduleFunctionality[moduleNumber]);
+    if (err2 || err3) {
+      break;
+    }
+  }
+
+  apci1710_unlock(board->pdev, irqstate);
+
+  if (err1 || err2 || err3) {
+    printk("%s: board %u: module probe failed (%d, %d, %d)\n", modulename, board->boardIndex, err1, err2, err3);
+    return -ENODEV;
+  }
+
+  for (moduleNumber = 0; moduleNumber < NUM_CTR_CHANNELS; moduleNumber++) {
+    printk("%s: board %u module %d: 0x%08x %s\n", modulename, board->boardIndex, moduleNumber,
+           board->moduleId[moduleNumber], functionalityName(board->moduleFunctionality[moduleNumber]));
+  }
+
+  return 0;
+}
+
+static int slac_inc_counter_kernel (counter_board_t *board)
+{
+  int err1 = 0, err2 = 0, err7 = 0, err8 = 0, err9 = 0;
+  unsigned long irqstate;
+  bool initFailed = false;
+  int moduleNumber;
+  struct pci_dev *pdev = board->pdev;
+
+  uint8_t b_CounterRange = APCI1710_32BIT_COUNTER;        // Selection form counter range.
+  uint8_t b_FirstCounterModus;                            // First counter acquisition mode.
+  uint8_t b_FirstCounterOption;                           // First counter option.
+
+  /* acquisition mode */
+  switch (mode) {
+    case 1:
+      b_FirstCounterModus = APCI1710_SIMPLE_MODE;
+      printk("%s: acquisition mode is SINGLE\n", modulename);
+      break;
+    case 2:
+      b_FirstCounterModus = APCI1710_DOUBLE_MODE;
+      printk("%s: acquisition mode is DOUBLE\n", modulename);
+      break;
+    case 4:
+    default:
+      b_FirstCounterModus = APCI1710_QUADRUPLE_MODE;
+      printk("%s: acquisition mode is QUADRUPLE\n", modulename);
+      break;
+  }
+
+  /* filter mode */
+  if (filter >= APCI1710CTR_FILTER_MIN && filter <= APCI1710CTR_FILTER_MAX) {
+    printk("%s: filter mode %d: filter from %d ns\n", modulename, filter, 100 + (50 * (filter - 1)));
+  } else if (filter == APCI1710CTR_FILTER_OFF) {
+    printk("%s: filter mode DISABLED (%d)\n", modulename, filter);
+  } else {
+    printk("%s: filter mode INVALID (%d)\n", modulename, filter);
+  }
+
+  /* hysteresis mode */
+  if (hysteresis) {
+    printk("%s: hysteresis mode is ENABLED\n", modulename);
+    b_FirstCounterOption = APCI1710_HYSTERESIS_ON;
+  } else {
+    printk("%s: hysteresis mode is DISABLED\n", modulename);
+    b_FirstCounterOption = APCI1710_HYSTERESIS_OFF;
+  }
+
+  for (moduleNumber = 0; moduleNumber < NUM_CTR_CHANNELS; moduleNumber++) {
+    if (!board->channel[moduleNumber].present) {
+      continue;
+    }
+
+    /* Lock the function to avoid parallel configurations */
+    apci1710_lock(pdev, &irqstate);
+
+    /* Initialise the incremental counter */
+    err1 = FAULT_KAPI(i_APCI1710_InitCounter (pdev,
+                        moduleNumber,
+                        b_CounterRange,
+                        b_FirstCounterModus,
+                        b_FirstCounterOption,
+                        b_FirstCounterModus,
+                        b_FirstCounterOption));
+
+    if (!err1) {
+      uint32_t dump;
+      err2 = FAULT_KAPI(i_APCI1710_SetDigitalChlOff(pdev, moduleNumber));
+      err7 = FAULT_KAPI(i_APCI1710_SetInputFilter(pdev, moduleNumber, APCI1710_40MHZ, filter));
+      err8 = FAULT_KAPI(i_APCI1710_Write32BitCounterValue(pdev, moduleNumber, 0));
+      /* read back counter in order to update latch value */
+      err9 = FAULT_KAPI(i_APCI1710_Read32BitCounterValue(pdev, moduleNumber, &dump));
+    }
+
+    /* Unlock the function so that other applications can call it */
+    apci1710_unlock(pdev, irqstate);
+
+    if (err1) {
+      initFailed = true;
+      printk ("i_APCI1710_InitCounter(%d) failed (%d)\n", moduleNumber, err1);
+    }
+
+    if (err2) {
+      initFailed = true;
+      printk ("i_APCI1710_SetDigitalChlOff failed (%d)\n", err2);
+    }
+
+    if (err7) {
+      initFailed = true;
+      printk ("i_APCI1710_SetInputFilter failed (%d)\n", err7);
+    }
+
+    if (err8) {
+      initFailed = true;
+      printk ("i_APCI1710_Write32BitCounterValue failed (%d)\n", err8);
+    }
+
+    if (err9) {
+      initFailed = true;
+      printk ("i_APCI1710_Read32BitCounterValue failed (%d)\n", err9);
+    }
+
+    if (!initFailed) {
+      printk ("%s: Initialization of board %u module %d successful\n", __FUNCTION__, board->boardIndex, moduleNumber);
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * apci1710_counterRead -
+ *
+ * Read the live counter value from the board; 0 on error.
+ */
+static int apci1710_counterRead(counter_channel_t *pchan, uint32_t *value)
+{
+  int err1;
+  unsigned long irqstate;
+  u64 start;
+
+  /* the value is at least this recent */
+  start = ktime_get_ns();
+  apci1710_lock(pchan->pdev, &irqstate);
+  err1 = FAULT_KAPI(i_APCI1710_Read32BitCounterValue(pchan->pdev, pchan->channelIndex, value));
+  apci1710_unlock(pchan->pdev, irqstate);
+
+  if (!err1) {
+    /* unless a write finished after the read started, which it may predate */
+    write_seqlock(&pchan->counterCache);
+    if (start > pchan->counterCacheSince) {
+      pchan->counterCacheValue = *value;
+      pchan->counterCacheTime = start;
+    }
+    write_sequnlock(&pchan->counterCache);
+  } else {
+    *value = 0;  /* default to 0 in case of error */
+    if (err1 == 3) {
+      printk("%s: %s: Counter %u not initialized\n", modulename, __FUNCTION__, pchan->minor);
+    } else {
+      printk("%s: %s: Counter %u error %d\n", modulename, __FUNCTION__, pchan->minor, err1);
+    }
+  }
+  return err1;
+}
+
+static int apci1710_counterWrite(counter_channel_t *pchan, uint32_t value)
+{
+  int err2;
+
+  err2 = FAULT_KAPI(i_APCI1710_Write32BitCounterValue(pchan->pdev, pchan->channelIndex, value));
+
+  /* neither the cached value nor earlier latches hold any more */
+  write_seqlock(&pchan->counterCache);
+  pchan->counterCacheTime = 0;
+  pchan->counterCacheSince = ktime_get_ns();
+  write_sequnlock(&pchan->counterCache);
+
+  if (err2 == 3) {
+    printk("%s: %s: Counter %u not initialized\n", modulename, __FUNCTION__, pchan->minor);
+  } else if (err2) {
+    printk("%s: %s: Counter %u error %d\n", modulename, __FUNCTION__, pchan->minor, err2);
+  }
+  return err2;
+}
+
+static int apci1710_digoutWrite(counter_channel_t *pchan, unsigned int val)
+{
+  int err3;
+  unsigned long irqstate;
+
+  apci1710_lock(pchan->pdev, &irqstate);
+  if (val) {
+    err3 = FAULT_KAPI(i_APCI1710_SetDigitalChlOn(pchan->pdev, pchan->channelIndex));
+  } else {
+    err3 = FAULT_KAPI(i_APCI1710_SetDigitalChlOff(pchan->pdev, pchan->channelIndex));
+  }
+  apci1710_unlock(pchan->pdev, irqstate);
+
+  /* error check */
+  if (err3 == 3) {
+    printk("%s: %s: Counter %u not initialized\n", modulename, __FUNCTION__, pchan->minor);
+  } else if (err3) {
+    printk("%s: %s: Counter %u error %d\n", modulename, __FUNCTION__, pchan->minor, err3);
+  }
+  return err3;
+}
+
+/*
+ * apci1710_counterCachedRead -
+ *
+ * Counter value no older than procmaxage us.  The newer of the last board
+ * read and the last latch on the latest-value page is used when it is
+ * recent enough, without taking the board lock; otherwise the board is
+ * read.  Synthetic records on the page are not counter values.
+ */
+static int apci1710_counterCachedRead(counter_channel_t *pchan, uint32_t *value)
+{
+  counterLatest_t lt;
+  uint32_t cached;
+  u64 time, since;
+  unsigned int seq;
+
+  if (procmaxage) {
+    do {
+      seq = read_seqbegin(&pchan->counterCache);
+      cached = pchan->counterCacheValue;
+      time = pchan->counterCacheTime;
+      since = pchan->counterCacheSince;
+    } while (read_seqretry(&pchan->counterCache, seq));
+
+    latestGet(pchan, &lt);
+    if (!(lt.flags & (APCI1710CTR_FLAG_PULSEENC | APCI1710CTR_FLAG_INJECT | APCI1710CTR_FLAG_REPLAY)) &&
+        (lt.time > since) && (lt.time > time)) {
+      cached = (uint32_t)lt.counter;
+      time = lt.time;
+    }
+
+    if (time && (ktime_get_ns() - time <= (u64)procmaxage * NSEC_PER_USEC)) {
+      atomic_inc(&pchan->counterCacheHits);
+      *value = cached;
+      return 0;
+    }
+  }
+  return apci1710_counterRead(pchan, value);
+}
+
+/* ===== /proc =================================================== */
+
+static int counter_proc_show(struct seq_file *m, void *v) {
+  uint32_t value;
+  counter_channel_t *pchan = (counter_channel_t *)m->private;
+
+  if ((pchan == NULL) || (pchan->channelIndex > NUM_CTR_CHANNELS)) {
+    printk("%s: %s: private data error\n", modulename, __FUNCTION__);
+    return -EFAULT;
+  }
+
+  (void) apci1710_counterCachedRead(pchan, &value);
+  seq_printf(m, "%d\n", value);
+  return 0;
+}
+
+static int counter_proc_open(struct inode *inode, struct  file *file) {
+  return single_open(file, counter_proc_show, PDE_DATA(inode));
+}
+
+static ssize_t counter_proc_write(struct file *file, const char __user *buf,  size_t count, loff_t *ppos) {
+  int val;
+  struct seq_file *ss = (struct seq_file *)file->private_data;
+  counter_channel_t *pchan = NULL;
+
+  if (ss) {
+    pchan = (counter_channel_t *)ss->private;
+  }
+
+  if ((pchan == NULL) || (pchan->channelIndex > NUM_CTR_CHANNELS)) {
+    printk("%s: %s: private data error\n", modulename, __FUNCTION__);
+    return -EFAULT;
+  }
+
+  if (kstrtoint_from_user(buf, count, 0, &val)) {
+    return -EFAULT;
+  }
+  if (pchan->pdev) {
+    (void) apci1710_counterWrite(pchan, (uint32_t) val);
+  }
+  return count;
+}
+
+static const struct file_operations counter_proc_fops = {
+  .owner = THIS_MODULE,
+  .open = counter_proc_open,
+  .read = seq_read,
+  .write = counter_proc_write,
+  .llseek = seq_lseek,
+  .release = single_release,
+};
+
+static int digout_proc_show(struct seq_file *m, void *v) {
+  seq_printf(m, "Usage:\n"
+                "echo {0|1} > digout\n"
+                "example: echo 1 > digout\n"
+                "sets value of digital output\n");
+  return 0;
+}
+
+static int digout_proc_open(struct inode *inode, struct  file *file) {
+  return single_open(file, digout_proc_show, PDE_DATA(inode));
+}
+
+static ssize_t digout_proc_write(struct file *file, const char __user *buf,  size_t count, loff_t *ppos) {
+  unsigned int val;
+  struct seq_file *ss = (struct seq_file *)file->private_data;
+  counter_channel_t *pchan = NULL;
+
+  if (ss) {
+    pchan = (counter_channel_t *)ss->private;
+  }
+
+  if ((pchan == NULL) || (pchan->channelIndex > NUM_CTR_CHANNELS)) {
+    printk("%s: %s: private data error\n", modulename, __FUNCTION__);
+    return -EFAULT;
+  }
+
+  if (kstrtouint_from_user(buf, count, 0, &val)) {
+    return -EFAULT;
+  }
+  if (val > 1) {
+    return -EINVAL;
+  }
+  if (pchan->pdev) {
+    (void) apci1710_digoutWrite(pchan, val);
+  }
+  return count;
+}
+
+static const struct file_operations digout_proc_fops = {
+  .owner = THIS_MODULE,
+  .open = digout_proc_open,
+  .read = seq_read,
+  .write = digout_proc_write,
+  .llseek = seq_lseek,
+  .release = single_release,
+};
+
+#ifdef INTENABLE_PROC
+
+static ssize_t intEnable_proc_read(struct file *file, char __user *buf, size_t size, loff_t *ppos) {
+  static const char message[] = "Usage:\n"
+                                "echo {0|1} > intEnable\n"
+                                "example: echo 1 > intEnable\n"
+                                "enable (1) or disable (0) counter interrupts\n";
+  return simple_read_from_buffer(buf, size, ppos, message, sizeof(message));
+}
+
+static ssize_t intEnable_proc_write(struct file *file, const char __user *buf,  size_t count, loff_t *ppos) {
+  unsigned int val;
+  counter_board_t *board = PDE_DATA(file_inode(file));
+
+  if (kstrtouint_from_user(buf, count, 0, &val)) {
+    return -EFAULT;
+  }
+  if (val > 1) {
+    return -EINVAL;
+  }
+  if (val) {
+    apci1710_intEnable_all(board);
+  } else {
+    apci1710_intDisable_all(board);
+  }
+
+  return count;
+}
+
+static const struct file_operations intEnable_proc_fops = {
+  .owner = THIS_MODULE,
+  .read = intEnable_proc_read,
+  .write = intEnable_proc_write,
+  .llseek = default_llseek,
+};
+
+#endif /* INTENABLE_PROC */
+
+static ssize_t statCtrl_proc_read(struct file *file, char __user *buf, size_t size, loff_t *ppos) {
+  static const char message[] = "Usage:\n"
+                                "echo 0 > statCtrl\n"
+                                "  stop collecting statistics\n"
+                                "echo 1 > statCtrl\n"
+                                "  start collecting statistics\n"
+                                "echo 2 > statCtrl\n"
+                                "  reset statistics\n"
+                                "echo 3 > statCtrl\n"
+                                "  start ignoring trigger intervals under 8ms\n"
+                                "echo 4 > statCtrl\n"
+                                "  stop ignoring trigger intervals under 8ms\n";
+  return simple_read_from_buffer(buf, size, ppos, message, sizeof(message));
+}
+
+static ssize_t statCtrl_proc_write(struct file *file, const char __user *buf,  size_t count, loff_t *ppos) {
+  unsigned int val;
+  ssize_t rv;
+  counter_channel_t *pchan = PDE_DATA(file_inode(file));
+
+  if (kstrtouint_from_user(buf, count, 0, &val)) {
+    return -EFAULT;
+  } else {
+    rv = count;
+  }
+  switch (val) {
+    case 0: statStop(pchan);                            break;
+    case 1: statStart(pchan);                           break;
+    case 2: statReset(pchan);                           break;
+    case 3: pchan->stat.ignoreEnabled = true;           break;
+    case 4: pchan->stat.ignoreEnabled = false;          break;
+    default: rv = -EINVAL;                              break;
+  }
+  return rv;
+}
+
+static const struct file_operations statCtrl_proc_fops = {
+  .owner = THIS_MODULE,
+  .read = statCtrl_proc_read,
+  .write = statCtrl_proc_write,
+  .llseek = default_llseek,
+};
+
+static int status_proc_show(struct seq_file *m, void *v) {
+  int ii;
+  unsigned long irqstate;
+  uint8_t status1;
+  uint32_t value2;
+  int err1, err2;
+  counter_channel_t *pchan = (counter_channel_t *)m->private;
+
+  if ((pchan == NULL) || (pchan->channelIndex > NUM_CTR_CHANNELS)) {
+    printk("%s: %s: private data error\n", modulename, __FUNCTION__);
+    return -EFAULT;
+  }
+
+  if (pchan->pdev) {
+    /* Lock the function to avoid parallel configurations */
+    apci1710_lock(pchan->pdev, &irqstate);
+
+    err1 = FAULT_KAPI(i_APCI1710_ReadLatchRegisterStatus(pchan->pdev, pchan->channelIndex, 0, &status1));
+    err2 = FAULT_KAPI(i_APCI1710_ReadLatchRegisterValue(pchan->pdev, pchan->channelIndex, 0, &value2));
+
+    /* Unlock the function so that other applications can call it */
+    apci1710_unlock(pchan->pdev, irqstate);
+
+    if (err1 == 3) {
+      seq_printf(m, "Counter not initialized\n");
+      return 0;
+    }
+
+    if (!err1 && !err2) {
+      seq_printf(m, "ReadLatchRegisterStatus: 0x%08x (%u)\n", status1, status1);
+      seq_printf(m, "ReadLatchRegisterValue:  %d (%u)\n", value2,  value2);
+    } else {
+      seq_printf(m, "ReadLatchRegisterStatus: 0x%08x (%u) (err=%d)\n", status1, status1, err1);
+      seq_printf(m, "ReadLatchRegisterValue:  %d (%u) (err=%d)\n", value2,  value2, err2);
+    }
+    seq_printf(m, "Interrupt count:  %d\n", interruptCountGet(pchan));
+    seq_printf(m, "Frame count:      %d\n", frameCountGet(pchan));
+    seq_printf(m, "Overflow count:   %d\n", overflowCountGet(pchan));
+    seq_printf(m, "Buffer level:     %u / %u\n", ringbufLevel(pchan), _ringSize - 1);
+    seq_printf(m, "Acquisition mode: %d: ", mode);
+    switch (mode) {
+      case 1: seq_printf(m, "Single"); break;
+      case 2: seq_printf(m, "Double"); break;
+      case 4: seq_printf(m, "Quadruple"); break;
+      default: seq_printf(m, "INVALID"); break;
+    }
+    seq_printf(m, "\n");
+    seq_printf(m, "Digital filter:  %2d: ", filter);
+    if (filter >= APCI1710CTR_FILTER_MIN && filter <= APCI1710CTR_FILTER_MAX) {
+      seq_printf(m, "Filter from %dns", 100 + (50 * (filter - 1)));
+    } else if (filter == APCI1710CTR_FILTER_OFF) {
+      seq_printf(m, "Filter not used");
+    } else {
+      seq_printf(m, "INVALID");
+    }
+    seq_printf(m, "\nHysteresis mode:  %s\n", hysteresis ? "ENABLED" : "DISABLED");
+    seq_printf(m, "Open resets:      %s\n", openreset ? "YES" : "NO");
+    seq_printf(m, "Counter cache:    %u us, %d hits\n", procmaxage, atomic_read(&pchan->counterCacheHits));
+    if (pchan->chronoModule >= 0) {
+      seq_printf(m, "Timestamp:        chronometer module %d\n", pchan->chronoModule);
+    } else {
+      seq_printf(m, "Timestamp:        CPU clock (us)\n");
+    }
+    if (pchan->reflex.count) {
+      seq_printf(m, "Reflex:           %u thresholds, region %d\n", pchan->reflex.count, pchan->reflexRegion);
+    }
+    if (pchan->pulseEncModule >= 0) {
+      seq_printf(m, "Pulse encoder:    module %d encoder %d\n", pchan->pulseEncModule, pchan->pulseEncoder);
+    }
+
+    if (pchan->channelIndex == STAT_CHANNEL) {
+      seq_printf(m, "--- trigger interval (ms) ---\n");
+    
+      for (ii = 0; ii < STAT_HISTO_BINS-1; ii++) {
+        seq_printf(m, "  %2d  : %-7d\n", ii, pchan->stat.histo[ii]);
+      }
+      seq_printf(m, "  %2d+ : %-7d\n", ii, pchan->stat.histo[ii]);
+      if (pchan->stat.ignoreEnabled) {
+        seq_printf(m, "ignored : %-7lu (interval less than 8ms)\n", pchan->stat.ignoreCount);
+      } else {
+        seq_printf(m, "ignoreEnabled is not set\n");
+      }
+    }
+
+  } else {
+    seq_printf(m, "lookupboard_by_index(%u) failed\n", pchan->board->boardIndex);
+  }
+  return 0;
+}
+
+static int status_proc_open(struct inode *inode, struct  file *file) {
+  return single_open(file, status_proc_show, PDE_DATA(inode));
+}
+
+static const struct file_operations status_proc_fops = {
+  .owner = THIS_MODULE,
+  .open = status_proc_open,
+  .read = seq_read,
+  .llseek = seq_lseek,
+  .release = single_release,
+};
+
+static int modules_proc_show(struct seq_file *m, void *v) {
+  unsigned int bb;
+  int ii;
+  counter_board_t *board;
+
+  for (bb = 0; bb < numBoards; bb++) {
+    board = boards[bb];
+    for (ii = 0; ii < NUM_CTR_CHANNELS; ii++) {
+      seq_printf(m, "%u.%d: 0x%08x %-20s ", bb, ii, board->moduleId[ii],
+                 functionalityName(board->moduleFunctionality[ii]));
+      if (board->channel[ii].present) {
+        seq_printf(m, "%s_%u\n", DEVNAME, board->channel[ii].minor);
+      } else {
+        seq_printf(m, "-\n");
+      }
+    }
+  }
+  seq_printf(m, "all: %s_all %s, %d overflows\n", DEVNAME,
+             allStream.open ? "open" : "closed", atomic_read(&allStream.overflowCount));
+  return 0;
+}
+
+static int modules_proc_open(struct inode *inode, struct  file *file) {
+  return single_open(file, modules_proc_show, NULL);
+}
+
+static const struct file_operations modules_proc_fops = {
+  .owner = THIS_MODULE,
+  .open = modules_proc_open,
+  .read = seq_read,
+  .llseek = seq_lseek,
+  .release = single_release,
+};
+
+/*
+ * stats_proc_read -
+ *
+ * Binary snapshot of all channels, see counterStatsHeader_t.
+ */
+static ssize_t stats_proc_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+  counterStatsHeader_t *hdr;
+  counterStatsChannel_t *st;
+  unsigned int bb;
+  int ii;
+  size_t size;
+  ssize_t rv;
+
+  size = sizeof(*hdr) + numBoards * NUM_CTR_CHANNELS * sizeof(*st);
+  hdr = kzalloc(size, GFP_KERNEL);
+  if (!hdr) {
+    return -ENOMEM;
+  }
+  hdr->version = APCI1710CTR_STATS_VERSION;
+  hdr->headerSize = sizeof(*hdr);
+  hdr->channelSize = sizeof(*st);
+
+  st = (counterStatsChannel_t *)(hdr + 1);
+  for (bb = 0; bb < numBoards; bb++) {
+    for (ii = 0; ii < NUM_CTR_CHANNELS; ii++) {
+      if (boards[bb]->channel[ii].present) {
+        apci1710_statsGet(boards[bb]->channel + ii, st + hdr->channels);
+        hdr->channels++;
+      }
+    }
+  }
+  size = sizeof(*hdr) + hdr->channels * sizeof(*st);
+
+  rv = simple_read_from_buffer(buf, count, ppos, hdr, size);
+  kfree(hdr);
+
+  return rv;
+}
+
+static const struct file_operations stats_proc_fops = {
+  .owner = THIS_MODULE,
+  .read = stats_proc_read,
+  .llseek = default_llseek,
+};
+
+/* per-channel proc entries */
+typedef struct {
+  const char *name;
+  umode_t mode;
+  const struct file_operations *fops;
+} ctr_proc_entry_t;
+
+static const ctr_proc_entry_t ctr_proc_entries[] = {
+  { "status",   0,    &status_proc_fops },
+  { "counter",  0666, &counter_proc_fops },
+  { "digout",   0666, &digout_proc_fops },
+};
+
+/* ===== /proc === ^^^ =========================================== */
+
+/* ===== sysfs =================================================== */
+
+/*
+ * Attributes of /sys/class/apci1710ctr/apci1710ctr_N.  Plain values come
+ * from the table below, which reads counterStatsChannel_t and therefore
+ * driver state only; counter and digout are the only ones that touch
+ * the board.
+ */
+
+typedef struct {
+  struct device_attribute dattr;
+  size_t offset;                    /* into counterStatsChannel_t */
+  bool isSigned;
+} ctr_stat_attr_t;
+
+static ssize_t ctr_stat_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+  counter_channel_t *pchan = dev_get_drvdata(dev);
+  ctr_stat_attr_t *sa = container_of(attr, ctr_stat_attr_t, dattr);
+  counterStatsChannel_t st;
+  void *field;
+
+  apci1710_statsGet(pchan, &st);
+  field = (char *)&st + sa->offset;
+  if (sa->isSigned) {
+    return scnprintf(buf, PAGE_SIZE, "%d\n", *(int *)field);
+  }
+  return scnprintf(buf, PAGE_SIZE, "%u\n", *(unsigned int *)field);
+}
+
+#define CTR_STAT_ATTR(_name, _field, _signed)                                 \
+  { .dattr = __ATTR(_name, 0444, ctr_stat_show, NULL),                        \
+    .offset = offsetof(counterStatsChannel_t, _field), .isSigned = _signed }
+
+static ctr_stat_attr_t ctr_stat_attrs[] = {
+  CTR_STAT_ATTR(interrupt_count,  interruptCount, false),
+  CTR_STAT_ATTR(frame_count,      frameCount,     false),
+  CTR_STAT_ATTR(overflow_count,   overflowCount,  false),
+  CTR_STAT_ATTR(ring_size,        ringSize,       false),
+  CTR_STAT_ATTR(ring_level,       ringLevel,      false),
+  CTR_STAT_ATTR(ring_high_water,  ringHighWater,  false),
+  CTR_STAT_ATTR(mode,             mode,           true),
+  CTR_STAT_ATTR(hysteresis,       hysteresis,     true),
+  CTR_STAT_ATTR(filter,           filter,         true),
+  CTR_STAT_ATTR(chrono_module,    chronoModule,   true),
+  CTR_STAT_ATTR(pulse_enc_module, pulseEncModule, true),
+  CTR_STAT_ATTR(el_module,        elModule,       true),
+  CTR_STAT_ATTR(reflex_count,     reflexCount,    false),
+  CTR_STAT_ATTR(reflex_region,    reflexRegion,   true),
+  CTR_STAT_ATTR(ignore_count,     ignoreCount,    false),
+};
+
+static ssize_t histogram_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+  counter_channel_t *pchan = dev_get_drvdata(dev);
+  ssize_t len = 0;
+  int ii;
+
+  for (ii = 0; ii < STAT_HISTO_BINS; ii++) {
+    len += scnprintf(buf + len, PAGE_SIZE - len, "%d%c", pchan->stat.histo[ii],
+                     (ii < STAT_HISTO_BINS - 1) ? ' ' : '\n');
+  }
+  return len;
+}
+
+static ssize_t latch_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+  counter_channel_t *pchan = dev_get_drvdata(dev);
+  counterLatest_t lt;
+
+  latestGet(pchan, &lt);
+  return scnprintf(buf, PAGE_SIZE, "%d\n", lt.counter);
+}
+
+static ssize_t int_enable_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+  counter_channel_t *pchan = dev_get_drvdata(dev);
+
+  return scnprintf(buf, PAGE_SIZE, "%d\n", pchan->intEnabled ? 1 : 0);
+}
+
+static ssize_t int_enable_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+  counter_channel_t *pchan = dev_get_drvdata(dev);
+  unsigned int val;
+
+  /* as digout; kstrtobool() needs Linux 4.6 */
+  if (kstrtouint(buf, 0, &val) || (val > 1)) {
+    return -EINVAL;
+  }
+  if (val) {
+    if (apci1710_intEnable(pchan)) {
+      return -EFAULT;
+    }
+  } else {
+    apci1710_intDisable(pchan, NULL);
+  }
+  return count;
+}
+
+static ssize_t counter_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+  counter_channel_t *pchan = dev_get_drvdata(dev);
+  uint32_t value;
+
+  if (apci1710_counterRead(pchan, &value)) {
+    return -EFAULT;
+  }
+  return scnprintf(buf, PAGE_SIZE, "%d\n", (int32_t)value);
+}
+
+static ssize_t counter_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+  counter_channel_t *pchan = dev_get_drvdata(dev);
+  int val;
+
+  if (kstrtoint(buf, 0, &val)) {
+    return -EINVAL;
+  }
+  if (apci1710_counterWrite(pchan, (uint32_t)val)) {
+    return -EFAULT;
+  }
+  return count;
+}
+
+static ssize_t digout_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+  counter_channel_t *pchan = dev_get_drvdata(dev);
+  unsigned int val;
+
+  if (kstrtouint(buf, 0, &val) || (val > 1)) {
+    return -EINVAL;
+  }
+  if (apci1710_digoutWrite(pchan, val)) {
+    return -EFAULT;
+  }
+  return count;
+}
+
+static DEVICE_ATTR(histogram, 0444, histogram_show, NULL);
+static DEVICE_ATTR(latch, 0444, latch_show, NULL);
+static DEVICE_ATTR(int_enable, 0644, int_enable_show, int_enable_store);
+static DEVICE_ATTR(counter, 0644, counter_show, counter_store);
+static DEVICE_ATTR(digout, 0200, NULL, digout_store);
+
+static struct device_attribute *ctr_attrs[] = {
+  &dev_attr_histogram,
+  &dev_attr_latch,
+  &dev_attr_int_enable,
+  &dev_attr_counter,
+  &dev_attr_digout,
+};
+
+/* filled from the tables above by counterSysfsInit() */
+static struct attribute *ctr_attr_list[ARRAY_SIZE(ctr_stat_attrs) + ARRAY_SIZE(ctr_attrs) + 1];
+
+static const struct attribute_group ctr_attr_group = {
+  .attrs = ctr_attr_list,
+};
+
+static const struct attribute_group *ctr_attr_groups[] = {
+  &ctr_attr_group,
+  NULL
+};
+
+static void counterSysfsInit(void)
+{
+  size_t ii, nn = 0;
+
+  for (ii = 0; ii < ARRAY_SIZE(ctr_stat_attrs); ii++) {
+    ctr_attr_list[nn++] = &ctr_stat_attrs[ii].dattr.attr;
+  }
+  for (ii = 0; ii < ARRAY_SIZE(ctr_attrs); ii++) {
+    ctr_attr_list[nn++] = &ctr_attrs[ii]->attr;
+  }
+  ctr_attr_list[nn] = NULL;
+}
+
+/* ===== sysfs === ^^^ =========================================== */
+
+static int counter_dev_open(struct inode *ii, struct file *filp)
+{
+  counter_channel_t *dev = container_of(ii->i_cdev, counter_channel_t, cdev);
+  counter_file_t *cf;
+  unsigned long irqstate;
+
+  cf = kzalloc(sizeof(*cf), GFP_KERNEL);
+  if (!cf) {
+    return -ENOMEM;
+  }
+  cf->pchan = dev;
+
+  mutex_lock(&dev->lock);     /* LOCK */
+
+  /*
+   * With openreset=0 a reader attaches to the running stream, so that
+   * restarting it loses nothing.  APCI1710CTR_IOCRESET still resets
+   * explicitly.
+   */
+  if (openreset) {
+    apci1710_softReset(dev, cf);    /* disable interrupts, reset ring buffer, clear stats */
+  }
+
+  apci1710_lock(dev->pdev, &irqstate);
+  list_add_tail(&cf->node, &dev->files);
+  apci1710_unlock(dev->pdev, irqstate);
+
+  mutex_unlock(&dev->lock);   /* UNLOCK */
+
+  filp->private_data = cf;    /* for other methods */
+
+  return 0;
+}
+
+static int counter_dev_fasync(int fd, struct file *filp, int on)
+{
+  counter_channel_t *pchan = ((counter_file_t *)filp->private_data)->pchan;
+
+  return fasync_helper(fd, filp, on, &pchan->fasync);
+}
+
+/*
+ * counter_dev_eventfd -
+ *
+ * Bind the eventfd fd to the channel on behalf of filp; -1 unbinds.
+ */
+static int counter_dev_eventfd(counter_channel_t *pchan, struct file *filp, int fd)
+{
+  struct eventfd_ctx *ctx = NULL;
+  struct eventfd_ctx *old;
+  unsigned long irqstate;
+
+  if (fd >= 0) {
+    ctx = eventfd_ctx_fdget(fd);
+    if (IS_ERR(ctx)) {
+      return PTR_ERR(ctx);
+    }
+  }
+
+  apci1710_lock(pchan->pdev, &irqstate);
+  old = pchan->eventfd;
+  pchan->eventfd = ctx;
+  pchan->eventfdOwner = ctx ? filp : NULL;
+  apci1710_unlock(pchan->pdev, irqstate);
+
+  if (old) {
+    eventfd_ctx_put(old);
+  }
+  return 0;
+}
+
+static int counter_dev_close(struct inode *ii, struct file *filp)
+{
+  counter_file_t *cf = filp->private_data;
+  counter_channel_t *pchan = cf->pchan;
+  unsigned long irqstate;
+
+  counter_dev_fasync(-1, filp, 0);
+  if (pchan->eventfdOwner == filp) {
+    counter_dev_eventfd(pchan, filp, -1);
+  }
+
+  apci1710_lock(pchan->pdev, &irqstate);
+  list_del(&cf->node);
+  apci1710_unlock(pchan->pdev, irqstate);
+  kfree(cf);
+  return 0;
+}
+
+/*
+ *  typedef struct counterBuf {
+ *    int             counter;
+ *    unsigned int    timestamp;
+ *    unsigned short  frameCount;
+ *    unsigned short  flags;
+ *  } counterBuf_t;
+ */
+
+static ssize_t counter_dev_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos)
+{
+  counter_channel_t *pchan = ((counter_file_t *)filp->private_data)->pchan;
+  counterBuf_t tmpbuf;
+
+  mutex_lock(&pchan->lock);             /* LOCK */
+
+  while (pchan->ring.head == pchan->ring.tail) {    /* buffer is empty */
+    /* nothing to read */
+    mutex_unlock(&pchan->lock);         /* UNLOCK */
+    if (filp->f_flags & O_NONBLOCK) {
+      return -EAGAIN;
+    }
+
+    /* read: going to sleep */
+    if (wait_event_interruptible(pchan->inq, pchan->ring.head != pchan->ring.tail)) {
+      return -ERESTARTSYS;
+    }
+
+    /* otherwise loop, but first reacquire the lock */
+    mutex_lock(&pchan->lock);           /* LOCK */
+  }
+
+  /* ok, data is there, return something */
+  ringbufPop(pchan, &tmpbuf);
+  count = min(count, sizeof(tmpbuf));
+  if (copy_to_user(buf, &tmpbuf, count)) {
+    mutex_unlock(&pchan->lock);         /* UNLOCK */
+    printk(KERN_WARNING "apci1710ctr: read(ctr=%u) = -EFAULT\n", pchan->channelIndex);
+    return -EFAULT;
+  }
+
+  mutex_unlock(&pchan->lock);           /* UNLOCK */
+
+  return count;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,16,0)
+/*
+ * counter_dev_read_iter -
+ *
+ * Batched read: as many whole records as are available and fit, blocking
+ * until there is at least one.  This also backs readv(), aio and, through
+ * generic_file_splice_read(), splice() and sendfile().  Plain read()
+ * keeps its one-record semantics.
+ */
+static ssize_t counter_dev_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+  struct file *filp = iocb->ki_filp;
+  counter_channel_t *pchan = ((counter_file_t *)filp->private_data)->pchan;
+  counterBuf_t tmpbuf;
+  bool nowait = (filp->f_flags & O_NONBLOCK);
+  ssize_t done = 0;
+
+#ifdef IOCB_NOWAIT
+  nowait = nowait || (iocb->ki_flags & IOCB_NOWAIT);
+#endif
+  if (iov_iter_count(to) < sizeof(tmpbuf)) {
+    return -EINVAL;
+  }
+
+  mutex_lock(&pchan->lock);             /* LOCK */
+
+  while (pchan->ring.head == pchan->ring.tail) {    /* buffer is empty */
+    mutex_unlock(&pchan->lock);         /* UNLOCK */
+    if (nowait) {
+      return -EAGAIN;
+    }
+    if (wait_event_interruptible(pchan->inq, pchan->ring.head != pchan->ring.tail)) {
+      return -ERESTARTSYS;
+    }
+    mutex_lock(&pchan->lock);           /* LOCK */
+  }
+
+  while ((iov_iter_count(to) >= sizeof(tmpbuf)) &&
+         ringbufPop(pchan, &tmpbuf)) {
+    if (copy_to_iter(&tmpbuf, sizeof(tmpbuf), to) != sizeof(tmpbuf)) {
+      if (!done) {
+        done = -EFAULT;
+      }
+      break;
+    }
+    done += sizeof(tmpbuf);
+  }
+
+  mutex_unlock(&pchan->lock);           /* UNLOCK */
+
+  return done;
+}
+#endif
+
+static unsigned int counter_dev_poll(struct file *filp, poll_table *wait)
+{
+  counter_file_t *cf = filp->private_data;
+  counter_channel_t *pchan = cf->pchan;
+  unsigned int mask = 0;
+
+  mutex_lock(&pchan->lock);             /* LOCK */
+
+  poll_wait(filp, &pchan->inq, wait);
+
+  if (pchan->ring.head != pchan->ring.tail) {
+    /* buffer is not empty */
+    mask |= POLLIN | POLLRDNORM;        /* readable */
+  }
+  if (cf->exceptions & APCI1710CTR_EXC_OVERFLOW) {
+    mask |= POLLPRI;
+  }
+  if (cf->exceptions & ~APCI1710CTR_EXC_OVERFLOW) {
+    mask |= POLLERR;
+  }
+
+  mutex_unlock(&pchan->lock);           /* UNLOCK */
+
+  return mask;
+}
+
+static long counter_dev_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+  counter_file_t *cf = filp->private_data;
+  counter_channel_t *pchan = cf->pchan;
+  long rv = 0;
+  int ii;
+  counterChrono_t chrono;
+  counterPulseEnc_t pulseEnc;
+  counterPulseEncStatus_t pulseEncStatus;
+  counterDigoutPulse_t digoutPulse;
+  counterReflex_t reflex;
+  counterGroup_t group;
+  counterGroupStatus_t groupStatus;
+  counterStatsChannel_t stats;
+  counterInject_t inj;
+  counterReplay_t replay;
+
+  switch (cmd) {
+    case APCI1710CTR_IOCRESET:
+      ii = apci1710_softReset(pchan, cf);    /* disable interrupts, reset ring buffer, clear stats */
+      if (ii) {
+        rv = -EFAULT;
+      }
+      break;
+
+    case APCI1710CTR_IOCINTENABLE:
+      ii = apci1710_intEnable(pchan);                  /* enable interrupts */
+      if (verbose) {
+        printk("%s: apci1710_intEnable(%u) returned %d\n", modulename, pchan->minor, ii);
+      }
+      if (ii) {
+        rv = -EFAULT;
+      }
+      break;
+
+    case APCI1710CTR_IOCINTDISABLE:
+      ii = apci1710_intDisable(pchan, cf);             /* disable interrupts */
+      if (ii) {
+        rv = -EFAULT;
+      }
+      break;
+
+    case APCI1710CTR_IOCSETINPUTFILTER:
+      ii = FAULT_KAPI(i_APCI1710_SetInputFilter(pchan->pdev, pchan->channelIndex, APCI1710_40MHZ, arg));
+      if (ii) {
+        rv = -EFAULT;
+      }
+      break;
+
+    case APCI1710CTR_IOCSETCHRONO:
+      if (copy_from_user(&chrono, (void __user *)arg, sizeof(chrono))) {
+        rv = -EFAULT;
+      } else {
+        rv = apci1710_chronoPair(pchan, &chrono);
+      }
+      break;
+
+    case APCI1710CTR_IOCSETPULSEENC:
+      if (copy_from_user(&pulseEnc, (void __user *)arg, sizeof(pulseEnc))) {
+        rv = -EFAULT;
+      } else {
+        rv = apci1710_pulseEncConfig(pchan, &pulseEnc);
+      }
+      break;
+
+    case APCI1710CTR_IOCWRITEPULSEENC:
+      if (get_user(ii, (unsigned int __user *)arg)) {
+        rv = -EFAULT;
+      } else {
+        rv = apci1710_pulseEncWrite(pchan, (uint32_t)ii);
+      }
+      break;
+
+    case APCI1710CTR_IOCDIGOUTPULSE:
+      if (copy_from_user(&digoutPulse, (void __user *)arg, sizeof(digoutPulse))) {
+        rv = -EFAULT;
+      } else {
+        rv = apci1710_digoutPulse(pchan, &digoutPulse);
+      }
+      break;
+
+    case APCI1710CTR_IOCSETREFLEX:
+      if (copy_from_user(&reflex, (void __user *)arg, sizeof(reflex))) {
+        rv = -EFAULT;
+      } else {
+        rv = apci1710_reflexConfig(pchan, &reflex);
+      }
+      break;
+
+    case APCI1710CTR_IOCSETGROUP:
+      if (copy_from_user(&group, (void __user *)arg, sizeof(group))) {
+        rv = -EFAULT;
+      } else {
+        rv = apci1710_groupSet(&group);
+      }
+      break;
+
+    case APCI1710CTR_IOCGROUPTRIGGER:
+      rv = apci1710_groupTrigger();
+      break;
+
+    case APCI1710CTR_IOCGETGROUP:
+      apci1710_groupStatus(&groupStatus);
+      if (copy_to_user((void __user *)arg, &groupStatus, sizeof(groupStatus))) {
+        rv = -EFAULT;
+      }
+      break;
+
+    case APCI1710CTR_IOCGETEXCEPTIONS:
+      if (put_user(exceptionFetch(cf), (unsigned int __user *)arg)) {
+        rv = -EFAULT;
+      }
+      break;
+
+    case APCI1710CTR_IOCSETEVENTFD:
+      if (get_user(ii, (int __user *)arg)) {
+        rv = -EFAULT;
+      } else {
+        rv = counter_dev_eventfd(pchan, filp, ii);
+      }
+      break;
+
+    case APCI1710CTR_IOCGETSTATS:
+      apci1710_statsGet(pchan, &stats);
+      if (copy_to_user((void __user *)arg, &stats, sizeof(stats))) {
+        rv = -EFAULT;
+      }
+      break;
+
+    case APCI1710CTR_IOCGETPULSEENC:
+      rv = apci1710_pulseEncStatus(pchan, &pulseEncStatus);
+      if (!rv && copy_to_user((void __user *)arg, &pulseEncStatus, sizeof(pulseEncStatus))) {
+        rv = -EFAULT;
+      }
+      break;
+
+    case APCI1710CTR_IOCINJECT:
+      if (copy_from_user(&inj, (void __user *)arg, sizeof(inj))) {
+        rv = -EFAULT;
+      } else {
+        rv = apci1710_inject(pchan, &inj);
+      }
+      break;
+
+    case APCI1710CTR_IOCREPLAY:
+      if (copy_from_user(&replay, (void __user *)arg, sizeof(replay))) {
+        rv = -EFAULT;
+      } else {
+        rv = apci1710_replay(pchan, &replay);
+      }
+      break;
+
+    default:
+      rv = -EINVAL;
+      break;
+  }
+
+  /* let other readers of the channel know */
+  if (!rv && ((cmd == APCI1710CTR_IOCSETINPUTFILTER) || (cmd == APCI1710CTR_IOCSETCHRONO) ||
+              (cmd == APCI1710CTR_IOCSETPULSEENC) || (cmd == APCI1710CTR_IOCSETREFLEX))) {
+    exceptionRaise(pchan, APCI1710CTR_EXC_RECONFIG, cf);
+  }
+
+  return rv;
+}
+
+/*
+ * counter_dev_mmap -
+ *
+ * Map the board's latest-value page read-only.
+ */
+static int counter_dev_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+  counter_channel_t *pchan = ((counter_file_t *)filp->private_data)->pchan;
+
+  if ((vma->vm_pgoff != 0) || (vma->vm_end - vma->vm_start > PAGE_SIZE)) {
+    return -EINVAL;
+  }
+  if (vma->vm_flags & VM_WRITE) {
+    return -EPERM;
+  }
+  vma->vm_flags &= ~VM_MAYWRITE;
+  vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
 
-static int status_proc_open_channel3(struct inode *inode, struct  file *file) {
-  return single_open(file, status_proc_show, &counter_channel[3]);
+  return remap_pfn_range(vma, vma->vm_start, virt_to_phys(pchan->board->latest) >> PAGE_SHIFT,
+                         vma->vm_end - vma->vm_start, vma->vm_page_prot);
 }
 
-static const struct file_operations status_proc_fops_channel0 = {
-  .owner = THIS_MODULE,
-  .open = status_proc_open_channel0,
-  .read = seq_read,
-  .llseek = seq_lseek,
-  .release = single_release,
-};
-
-static const struct file_operations status_proc_fops_channel1 = {
+static struct file_operations counter_fops = {
   .owner = THIS_MODULE,
-  .open = status_proc_open_channel1,
-  .read = seq_read,
-  .llseek = seq_lseek,
-  .release = single_release,
+  .open = counter_dev_open,
+  .release = counter_dev_close,
+  .read = counter_dev_read,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,16,0)
+  .read_iter = counter_dev_read_iter,
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,9,0)
+  .splice_read = generic_file_splice_read,    /* built on read_iter since 4.9 */
+#endif
+  .poll = counter_dev_poll,
+  .mmap = counter_dev_mmap,
+  .fasync = counter_dev_fasync,
+  .unlocked_ioctl = counter_dev_ioctl
 };
 
-static const struct file_operations status_proc_fops_channel2 = {
-  .owner = THIS_MODULE,
-  .open = status_proc_open_channel2,
-  .read = seq_read,
-  .llseek = seq_lseek,
-  .release = single_release,
-};
+/* ===== aggregated stream ======================================= */
 
-static const struct file_operations status_proc_fops_channel3 = {
-  .owner = THIS_MODULE,
-  .open = status_proc_open_channel3,
-  .read = seq_read,
-  .llseek = seq_lseek,
-  .release = single_release,
-};
+/*
+ * allbufPushLocked -
+ *
+ * Append one channel record to the aggregated stream if it is open.
+ * This routine must be called with the board lock HELD.
+ */
+static void allbufPushLocked(counter_channel_t *pchan, int32_t counter, uint32_t timestamp, uint16_t flags)
+{
+  counterAllBuf_t *el;
+  int tmpIndex;
 
-/* ===== /proc === ^^^ =========================================== */
+  spin_lock(&allStream.lock);
+  if (allStream.open) {
+    if (! CIRC_SPACE(allStream.ring.head, allStream.ring.tail, allStream.size)) {
+      atomic_inc(&allStream.overflowCount);
+    } else {
+      tmpIndex = (allStream.ring.head + 1) % allStream.size;
+      el = allStream.ringBuf + tmpIndex;
+      el->rec.counter = counter;
+      el->rec.timestamp = timestamp;
+      el->rec.frameCount = pchan->allFrameCount;
+      el->rec.flags = flags;
+      el->channel = pchan->minor;
+      allStream.ring.head = tmpIndex;
+      wake_up_interruptible(&allStream.inq);
+    }
+    pchan->allFrameCount++;
+  }
+  spin_unlock(&allStream.lock);
+}
 
-static int counter_dev_open(struct inode *ii, struct file *filp)
+static bool allbufPop(counterAllBuf_t *el)
 {
-  counter_channel_t *dev = container_of(ii->i_cdev, counter_channel_t, cdev);
-
-  mutex_lock(&dev->lock);     /* LOCK */
+  unsigned long irqstate;
+  int tmpIndex;
+  bool rv = false;
+
+  spin_lock_irqsave(&allStream.lock, irqstate);
+  if (allStream.ring.head != allStream.ring.tail) {
+    tmpIndex = (allStream.ring.tail + 1) % allStream.size;
+    *el = allStream.ringBuf[tmpIndex];
+    allStream.ring.tail = tmpIndex;
+    rv = true;
+  }
+  spin_unlock_irqrestore(&allStream.lock, irqstate);
 
-  apci1710_softReset(dev);    /* disable interrupts, reset ring buffer, clear stats */
+  return rv;
+}
 
-  mutex_unlock(&dev->lock);   /* UNLOCK */
+static int all_dev_open(struct inode *ii, struct file *filp)
+{
+  unsigned long irqstate;
+  unsigned int bb;
+  int jj;
+  int rv = 0;
 
-  filp->private_data = dev;   /* for other methods */
+  spin_lock_irqsave(&allStream.lock, irqstate);
+  if (allStream.open) {
+    /* reads consume records, so only one reader makes sense */
+    rv = -EBUSY;
+  } else {
+    allStream.ring.head = allStream.ring.tail = 0;
+    atomic_set(&allStream.overflowCount, 0);
+    for (bb = 0; bb < numBoards; bb++) {
+      for (jj = 0; jj < NUM_CTR_CHANNELS; jj++) {
+        boards[bb]->channel[jj].allFrameCount = 0;
+      }
+    }
+    allStream.open = true;
+  }
+  spin_unlock_irqrestore(&allStream.lock, irqstate);
 
-  return 0;
+  return rv;
 }
 
-static int counter_dev_close(struct inode *ii, struct file *filp)
+static int all_dev_close(struct inode *ii, struct file *filp)
 {
+  unsigned long irqstate;
+
+  spin_lock_irqsave(&allStream.lock, irqstate);
+  allStream.open = false;
+  spin_unlock_irqrestore(&allStream.lock, irqstate);
+
   return 0;
 }
 
 /*
- *  typedef struct counterBuf {
- *    int             counter;
- *    unsigned int    timestamp;
- *    unsigned short  frameCount;
- *    unsigned short  flags;
- *  } counterBuf_t;
+ * all_dev_read -
+ *
+ * Return as many whole counterAllBuf_t records as are available and fit,
+ * blocking until there is at least one.
  */
-
-static ssize_t counter_dev_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos)
+static ssize_t all_dev_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos)
 {
-  counter_channel_t *pchan = filp->private_data;
-  counterBuf_t tmpbuf;
+  counterAllBuf_t tmpbuf;
+  size_t done = 0;
 
-  mutex_lock(&pchan->lock);             /* LOCK */
+  if (count < sizeof(tmpbuf)) {
+    return -EINVAL;
+  }
 
-  while (pchan->ring.head == pchan->ring.tail) {    /* buffer is empty */
-    /* nothing to read */
-    mutex_unlock(&pchan->lock);         /* UNLOCK */
+  mutex_lock(&allStream.readLock);      /* LOCK */
+
+  while (allStream.ring.head == allStream.ring.tail) {
+    mutex_unlock(&allStream.readLock);  /* UNLOCK */
     if (filp->f_flags & O_NONBLOCK) {
       return -EAGAIN;
     }
-
-    /* read: going to sleep */
-    if (wait_event_interruptible(pchan->inq, pchan->ring.head != pchan->ring.tail)) {
+    if (wait_event_interruptible(allStream.inq, allStream.ring.head != allStream.ring.tail)) {
       return -ERESTARTSYS;
     }
-
-    /* otherwise loop, but first reacquire the lock */
-    mutex_lock(&pchan->lock);           /* LOCK */
+    mutex_lock(&allStream.readLock);    /* LOCK */
   }
 
-  /* ok, data is there, return something */
-  ringbufPop(pchan, &tmpbuf.counter, &tmpbuf.frameCount, &tmpbuf.flags, &tmpbuf.timestamp);
-  count = min(count, sizeof(tmpbuf));
-  if (copy_to_user(buf, &tmpbuf, count)) {
-    mutex_unlock(&pchan->lock);         /* UNLOCK */
-    printk(KERN_WARNING "apci1710ctr: read(ctr=%u) = -EFAULT\n", pchan->channelIndex);
-    return -EFAULT;
+  while ((count - done >= sizeof(tmpbuf)) && allbufPop(&tmpbuf)) {
+    if (copy_to_user(buf + done, &tmpbuf, sizeof(tmpbuf))) {
+      mutex_unlock(&allStream.readLock);  /* UNLOCK */
+      return done ? done : -EFAULT;
+    }
+    done += sizeof(tmpbuf);
   }
 
-  mutex_unlock(&pchan->lock);           /* UNLOCK */
+  mutex_unlock(&allStream.readLock);    /* UNLOCK */
 
-  return count;
+  return done;
 }
 
-static unsigned int counter_dev_poll(struct file *filp, poll_table *wait)
+static unsigned int all_dev_poll(struct file *filp, poll_table *wait)
 {
-  counter_channel_t *pchan = filp->private_data;
   unsigned int mask = 0;
 
-  mutex_lock(&pchan->lock);             /* LOCK */
-
-  poll_wait(filp, &pchan->inq, wait);
+  poll_wait(filp, &allStream.inq, wait);
 
-  if (pchan->ring.head != pchan->ring.tail) {
-    /* buffer is not empty */
+  if (allStream.ring.head != allStream.ring.tail) {
     mask |= POLLIN | POLLRDNORM;        /* readable */
   }
 
-  mutex_unlock(&pchan->lock);           /* UNLOCK */
-
   return mask;
 }
 
-static long counter_dev_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
-{
-  counter_channel_t *pchan = filp->private_data;
-  long rv = 0;
-  int ii;
-
-  switch (cmd) {
-    case APCI1710CTR_IOCRESET:
-      ii = apci1710_softReset(pchan);        /* disable interrupts, reset ring buffer, clear stats */
-      if (ii) {
-        rv = -EFAULT;
-      }
-      break;
-
-    case APCI1710CTR_IOCINTENABLE:
-      ii = apci1710_intEnable(pchan->channelIndex);    /* enable interrupts */
-      if (verbose) {
-        printk("%s: apci1710_intEnable(%u) returned %d\n", modulename, pchan->channelIndex, ii);
-      }
-      if (ii) {
-        rv = -EFAULT;
-      }
-      break;
+static struct file_operations all_fops = {
+  .owner = THIS_MODULE,
+  .open = all_dev_open,
+  .release = all_dev_close,
+  .read = all_dev_read,
+  .poll = all_dev_poll
+};
 
-    case APCI1710CTR_IOCINTDISABLE:
-      ii = apci1710_intDisable(pchan->channelIndex);   /* disable interrupts */
-      if (ii) {
-        rv = -EFAULT;
-      }
-      break;
+static int allStreamInit(void)
+{
+  spin_lock_init(&allStream.lock);
+  mutex_init(&allStream.readLock);
+  init_waitqueue_head(&allStream.inq);
+  allStream.open = false;
+  /* CIRC_CNT() needs a power of 2 */
+  allStream.size = roundup_pow_of_two(_ringSize * NUM_CTR_CHANNELS * numBoards);
+  allStream.ring.head = allStream.ring.tail = 0;
+  atomic_set(&allStream.overflowCount, 0);
+  allStream.ringBuf = kmalloc(allStream.size * sizeof(counterAllBuf_t), GFP_KERNEL);
+
+  return allStream.ringBuf ? 0 : -ENOMEM;
+}
 
-    case APCI1710CTR_IOCSETINPUTFILTER:
-      ii = i_APCI1710_SetInputFilter(pchan->pdev, pchan->channelIndex, APCI1710_40MHZ, arg);
-      if (ii) {
-        rv = -EFAULT;
-      }
-      break;
+/* ===== aggregated stream === ^^^ =============================== */
 
-    default:
-      rv = -EINVAL;
-      break;
+/*
+ * counterBoardsRelease -
+ *
+ * Undo the per-board part of apci1710ctr_init(), last board first.
+ */
+static void counterBoardsRelease(void)
+{
+  while (numBoards > 0) {
+    numBoards--;
+    counterModuleFini(boards[numBoards]);
+    kfree(boards[numBoards]);
+    boards[numBoards] = NULL;
   }
-
-  return rv;
 }
 
-static struct file_operations counter_fops = {
-  .owner = THIS_MODULE,
-  .open = counter_dev_open,
-  .release = counter_dev_close,
-  .read = counter_dev_read,
-  .poll = counter_dev_poll,
-  .unlocked_ioctl = counter_dev_ioctl
-};
-
 /** Called when module loads. */
 static int __init apci1710ctr_init(void)
 {
   dev_t devid;
   int rc;
-  int board_index = 0;
+  unsigned int bb;
+  struct pci_dev *pdev;
+  counter_board_t *board;
+  counter_channel_t *pchan;
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,26)
-  int minor;
+  int ii;
 #endif
 
-  printk("%s: looking for board %u\n", modulename,board_index);
-  _pdev = apci1710_lookup_board_by_index(0);
-  if (!_pdev) {
-    printk("%s: board %u not found\n", modulename, board_index);
+  /* CIRC_CNT() needs a power of 2 */
+  BUILD_BUG_ON(APCI1710CTR_DEFAULT_RINGSIZE & (APCI1710CTR_DEFAULT_RINGSIZE - 1));
+
+  /* enumerate every board known to the vendor driver */
+  for (bb = 0; bb < MAX_BOARDS; bb++) {
+    printk("%s: looking for board %u\n", modulename, bb);
+    pdev = apci1710_lookup_board_by_index(bb);
+    if (!pdev) {
+      break;
+    }
+
+    board = kzalloc(sizeof(counter_board_t), GFP_KERNEL);
+    if (!board) {
+      counterBoardsRelease();
+      return -ENOMEM;
+    }
+    board->boardIndex = bb;
+    board->pdev = pdev;
+
+    printk("%s: probing modules on board %u\n", modulename, bb);
+    if (apci1710_probeModules(board)) {
+      kfree(board);
+      counterBoardsRelease();
+      return -ENODEV;
+    }
+
+    printk("%s: calling counterModuleInit(%u)\n", modulename, bb);
+    if (counterModuleInit(board)) {
+      kfree(board);
+      counterBoardsRelease();
+      return -ENOMEM;
+    }
+    boards[numBoards++] = board;
+  }
+
+  if (!numBoards) {
+    printk("%s: board 0 not found\n", modulename);
     return -ENODEV;
   }
+  printk("%s: %u board(s) found\n", modulename, numBoards);
 
-  printk("%s: calling counterModuleInit()\n", modulename);
-  counterModuleInit();
+  apci1710_groupInit();
+
+  if (allStreamInit()) {
+    counterBoardsRelease();
+    return -ENOMEM;
+  }
 
   apci1710ctr_proc_create();
 
-  /* allocate device numbers */
+  /* allocate device numbers, NUM_CTR_CHANNELS per board plus the aggregated stream */
   if (major) {
     /* nonzero major number was set by module parameter */
     devid = MKDEV(major, 0);
-    rc = register_chrdev_region(devid, NUM_CTR_CHANNELS, DEVNAME);
+    rc = register_chrdev_region(devid, ALL_MINOR + 1, DEVNAME);
   } else {
     /* major number allocated dynamically */
-    rc = alloc_chrdev_region(&devid, 0, NUM_CTR_CHANNELS, DEVNAME);
+    rc = alloc_chrdev_region(&devid, 0, ALL_MINOR + 1, DEVNAME);
     major = MAJOR(devid);
   }
   if (rc < 0) {
@@ -1146,33 +3485,48 @@ static int __init apci1710ctr_init(void)
     printk(DEVNAME ": major = %d\n", major);
   }
 
-  /* initialize a read queue and mutex for each counter channel */
-  for (minor = 0; minor < NUM_CTR_CHANNELS; minor++) {
-    init_waitqueue_head(&counter_channel[minor].inq);
-    mutex_init(&counter_channel[minor].lock);
-  }
-
   /* create a char device for each counter channel */
+  counterSysfsInit();
   apci1710ctr_class = class_create (THIS_MODULE, DEVNAME);
   if (IS_ERR(apci1710ctr_class)) {
     printk (KERN_WARNING "%s: class_create() error\n", DEVNAME );
   } else {
-    for (minor = 0; minor < NUM_CTR_CHANNELS; minor++) {
-      cdev_init(&counter_channel[minor].cdev, &counter_fops);
-      counter_channel[minor].cdev.owner = THIS_MODULE;
-      if (cdev_add(&counter_channel[minor].cdev, MKDEV(major, minor), 1) == -1) {
-        printk (KERN_WARNING "%s_%d: cdev_add() error\n", DEVNAME, minor);
-      } else {
-        counter_channel[minor].dev = device_create(apci1710ctr_class, NULL, MKDEV(major, minor), NULL, "%s_%d", DEVNAME, minor);
-        if (IS_ERR(counter_channel[minor].dev)) {
-          printk (KERN_WARNING "%s_%d: device_create() error\n", DEVNAME, minor);
+    for (bb = 0; bb < numBoards; bb++) {
+      for (ii = 0; ii < NUM_CTR_CHANNELS; ii++) {
+        pchan = boards[bb]->channel + ii;
+        if (!pchan->present) {
+          continue;
+        }
+        cdev_init(&pchan->cdev, &counter_fops);
+        pchan->cdev.owner = THIS_MODULE;
+        if (cdev_add(&pchan->cdev, MKDEV(major, pchan->minor), 1) == -1) {
+          printk (KERN_WARNING "%s_%u: cdev_add() error\n", DEVNAME, pchan->minor);
+        } else {
+          pchan->dev = device_create_with_groups(apci1710ctr_class, NULL, MKDEV(major, pchan->minor), pchan,
+                                                 ctr_attr_groups, "%s_%u", DEVNAME, pchan->minor);
+          if (IS_ERR(pchan->dev)) {
+            printk (KERN_WARNING "%s_%u: device_create() error\n", DEVNAME, pchan->minor);
+          }
         }
       }
     }
+
+    cdev_init(&allStream.cdev, &all_fops);
+    allStream.cdev.owner = THIS_MODULE;
+    if (cdev_add(&allStream.cdev, MKDEV(major, ALL_MINOR), 1) == -1) {
+      printk (KERN_WARNING "%s_all: cdev_add() error\n", DEVNAME);
+    } else {
+      allStream.dev = device_create(apci1710ctr_class, NULL, MKDEV(major, ALL_MINOR), NULL, "%s_all", DEVNAME);
+      if (IS_ERR(allStream.dev)) {
+        printk (KERN_WARNING "%s_all: device_create() error\n", DEVNAME);
+      }
+    }
   }
 
   /* initial configuration of hardware */
-  slac_inc_counter_kernel();
+  for (bb = 0; bb < numBoards; bb++) {
+    slac_inc_counter_kernel(boards[bb]);
+  }
 
   return 0;
 }
@@ -1181,84 +3535,140 @@ static int __init apci1710ctr_init(void)
 /** Called when module is unloaded. */
 static void __exit apci1710ctr_exit(void)
 {
+  int bb;
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,0)
-  int minor = 0;
+  int ii;
+  counter_channel_t *pchan;
+
   if (apci1710ctr_class && !IS_ERR(apci1710ctr_class)) {
-    for (minor = NUM_CTR_CHANNELS - 1; minor >= 0; minor--) {
-      device_destroy(apci1710ctr_class, MKDEV(major, minor));
-      cdev_del(&counter_channel[minor].cdev);
+    device_destroy(apci1710ctr_class, MKDEV(major, ALL_MINOR));
+    cdev_del(&allStream.cdev);
+    for (bb = numBoards - 1; bb >= 0; bb--) {
+      for (ii = NUM_CTR_CHANNELS - 1; ii >= 0; ii--) {
+        pchan = boards[bb]->channel + ii;
+        if (!pchan->present) {
+          continue;
+        }
+        device_destroy(apci1710ctr_class, MKDEV(major, pchan->minor));
+        cdev_del(&pchan->cdev);
+      }
     }
     class_destroy(apci1710ctr_class);
   }
 #endif
 
   /* free device numbers */
-  unregister_chrdev_region(MKDEV(major,0), NUM_CTR_CHANNELS);
+  unregister_chrdev_region(MKDEV(major,0), ALL_MINOR + 1);
 
   apci1710ctr_proc_remove();
 
+  /* no more interrupt callbacks, before the timers and memory go */
+  for (bb = 0; bb < numBoards; bb++) {
+    counterBoardQuiesce(boards[bb]);
+  }
+
+  hrtimer_cancel(&captureGroup.timer);
+
   printk("%s: calling counterModuleFini()\n", modulename);
-  counterModuleFini();
+  counterBoardsRelease();
+
+  kfree(allStream.ringBuf);
 }
 //------------------------------------------------------------------------------
 
+/*
+ * apci1710ctr_proc_create -
+ *
+ * Board-wide entries live under CTR_PROC_DIRNAME; each board gets a
+ * "boardN" directory there linking to its channel directories, which
+ * keep the CTR_PROC_DIRNAME "<minor>" names used before multi-board.
+ */
 void apci1710ctr_proc_create(void)
 {
-  printk("%s: calling proc_create()\n", modulename);
-
-  proc_parent[0] = proc_mkdir(CTR_PROC_DIRNAME0, NULL);
-  proc_parent[1] = proc_mkdir(CTR_PROC_DIRNAME1, NULL);
-  proc_parent[2] = proc_mkdir(CTR_PROC_DIRNAME2, NULL);
-  proc_parent[3] = proc_mkdir(CTR_PROC_DIRNAME3, NULL);
+  char name[32];
+  char target[48];
+  unsigned int bb;
+  int ii;
+  size_t jj;
+  counter_board_t *board;
+  counter_channel_t *pchan;
 
-  proc_create(CTR_PROC_DIRNAME0 "/status", 0, NULL, &status_proc_fops_channel0);
-  proc_create(CTR_PROC_DIRNAME1 "/status", 0, NULL, &status_proc_fops_channel1);
-  proc_create(CTR_PROC_DIRNAME2 "/status", 0, NULL, &status_proc_fops_channel2);
-  proc_create(CTR_PROC_DIRNAME3 "/status", 0, NULL, &status_proc_fops_channel3);
+  printk("%s: calling proc_create()\n", modulename);
 
-  proc_create(CTR_PROC_DIRNAME0 "/counter", 0666, NULL, &counter_proc_fops_channel0);
-  proc_create(CTR_PROC_DIRNAME1 "/counter", 0666, NULL, &counter_proc_fops_channel1);
-  proc_create(CTR_PROC_DIRNAME2 "/counter", 0666, NULL, &counter_proc_fops_channel2);
-  proc_create(CTR_PROC_DIRNAME3 "/counter", 0666, NULL, &counter_proc_fops_channel3);
+  proc_top = proc_mkdir(CTR_PROC_DIRNAME, NULL);
+  if (proc_top) {
+    proc_create("modules", 0, proc_top, &modules_proc_fops);
+    proc_create("stats", 0444, proc_top, &stats_proc_fops);
+#ifdef APCI1710CTR_DEBUG
+    proc_create("faults", 0444, proc_top, &faults_proc_fops);
+#endif
+  }
 
-  proc_create(CTR_PROC_DIRNAME0 "/digout", 0666, NULL, &digout_proc_fops_channel0);
-  proc_create(CTR_PROC_DIRNAME1 "/digout", 0666, NULL, &digout_proc_fops_channel1);
-  proc_create(CTR_PROC_DIRNAME2 "/digout", 0666, NULL, &digout_proc_fops_channel2);
-  proc_create(CTR_PROC_DIRNAME3 "/digout", 0666, NULL, &digout_proc_fops_channel3);
+  for (bb = 0; bb < numBoards; bb++) {
+    board = boards[bb];
 
+    board->proc_dir = NULL;
+    if (proc_top) {
+      snprintf(name, sizeof(name), "board%u", bb);
+      board->proc_dir = proc_mkdir(name, proc_top);
+    }
 #ifdef INTENABLE_PROC
-  proc_create(CTR_PROC_DIRNAME0 "/intEnable", 0666, NULL, &intEnable_proc_fops);
+    if (board->proc_dir) {
+      proc_create_data("intEnable", 0666, board->proc_dir, &intEnable_proc_fops, board);
+    }
 #endif /* INTENABLE_PROC */
-  proc_create(CTR_PROC_DIRNAME1 "/statCtrl", 0666, NULL, &statCtrl_proc_fops);
+
+    for (ii = 0; ii < NUM_CTR_CHANNELS; ii++) {
+      pchan = board->channel + ii;
+      pchan->proc_dir = NULL;
+      if (!pchan->present) {
+        continue;
+      }
+
+      snprintf(name, sizeof(name), CTR_PROC_DIRNAME "%u", pchan->minor);
+      pchan->proc_dir = proc_mkdir(name, NULL);
+      if (!pchan->proc_dir) {
+        printk("%s: proc_mkdir(%s) failed\n", modulename, name);
+        continue;
+      }
+
+      for (jj = 0; jj < ARRAY_SIZE(ctr_proc_entries); jj++) {
+        proc_create_data(ctr_proc_entries[jj].name, ctr_proc_entries[jj].mode, pchan->proc_dir,
+                         ctr_proc_entries[jj].fops, pchan);
+      }
+      if (ii == STAT_CHANNEL) {
+        proc_create_data("statCtrl", 0666, pchan->proc_dir, &statCtrl_proc_fops, pchan);
+      }
+
+      if (board->proc_dir) {
+        snprintf(name, sizeof(name), "ctr%d", ii);
+        snprintf(target, sizeof(target), "../../apci1710ctr%u", pchan->minor);
+        proc_symlink(name, board->proc_dir, target);
+      }
+    }
+  }
 }
 
 void apci1710ctr_proc_remove(void)
 {
+  unsigned int bb;
+  int ii;
+
   printk("%s: calling proc_remove()\n", modulename);
-  if (proc_parent[0]) {
-    remove_proc_entry(CTR_PROC_DIRNAME0 "/status", NULL);
-    remove_proc_entry(CTR_PROC_DIRNAME0 "/counter", NULL);
-    remove_proc_entry(CTR_PROC_DIRNAME0 "/digout", NULL);
-    proc_remove(proc_parent[0]);
-  }
-  if (proc_parent[1]) {
-    remove_proc_entry(CTR_PROC_DIRNAME1 "/status", NULL);
-    remove_proc_entry(CTR_PROC_DIRNAME1 "/counter", NULL);
-    remove_proc_entry(CTR_PROC_DIRNAME1 "/digout", NULL);
-    remove_proc_entry(CTR_PROC_DIRNAME1 "/statCtrl", NULL);
-    proc_remove(proc_parent[1]);
-  }
-  if (proc_parent[2]) {
-    remove_proc_entry(CTR_PROC_DIRNAME2 "/status", NULL);
-    remove_proc_entry(CTR_PROC_DIRNAME2 "/counter", NULL);
-    remove_proc_entry(CTR_PROC_DIRNAME2 "/digout", NULL);
-    proc_remove(proc_parent[2]);
+  for (bb = 0; bb < numBoards; bb++) {
+    for (ii = 0; ii < NUM_CTR_CHANNELS; ii++) {
+      if (boards[bb]->channel[ii].proc_dir) {
+        /* removes the whole subtree */
+        proc_remove(boards[bb]->channel[ii].proc_dir);
+        boards[bb]->channel[ii].proc_dir = NULL;
+      }
+    }
+    boards[bb]->proc_dir = NULL;
   }
-  if (proc_parent[3]) {
-    remove_proc_entry(CTR_PROC_DIRNAME3 "/status", NULL);
-    remove_proc_entry(CTR_PROC_DIRNAME3 "/counter", NULL);
-    remove_proc_entry(CTR_PROC_DIRNAME3 "/digout", NULL);
-    proc_remove(proc_parent[3]);
+  if (proc_top) {
+    /* takes the board directories with it */
+    proc_remove(proc_top);
+    proc_top = NULL;
   }
 }
 
@@ -1274,49 +3684,127 @@ static unsigned int ringbufLevel(counter_channel_t *pchan)
   unsigned int rv;
 
   apci1710_lock(pchan->pdev, &irqstate);
-  rv = CIRC_CNT(pchan->ring.head, pchan->ring.tail, _ringSize);
+  rv = ctrRingLevel(&pchan->ring);
   apci1710_unlock(pchan->pdev, irqstate);
 
   return rv;
 }
 
+/*
+ * latestUpdateLocked -
+ *
+ * Publish a latched value on the board's latest-value page, with its
+ * frame count and the channel's counts including that value, so an
+ * overflow shows up together with the value that was lost to it.
+ * This routine must be called with the board lock HELD, which is what
+ * serializes the writers of each seq.
+ */
+static void latestUpdateLocked(counter_channel_t *pchan, int32_t counter, uint32_t timestamp,
+                               uint16_t frameCount, uint16_t flags)
+{
+  counterLatest_t *lt = &pchan->board->latest->channel[pchan->channelIndex];
+
+  WRITE_ONCE(lt->seq, lt->seq + 1);
+  smp_wmb();
+  lt->counter = counter;
+  lt->timestamp = timestamp;
+  lt->frameCount = frameCount;
+  lt->flags = flags;
+  lt->interruptCount = interruptCountGet(pchan);
+  lt->overflowCount = overflowCountGet(pchan);
+  lt->time = ktime_get_ns();
+  smp_wmb();
+  WRITE_ONCE(lt->seq, lt->seq + 1);
+}
+
+/*
+ * latestGet -
+ *
+ * Consistent copy of the channel's latest-value entry, without the board
+ * lock.
+ */
+static void latestGet(counter_channel_t *pchan, counterLatest_t *dst)
+{
+  const counterLatest_t *lt = &pchan->board->latest->channel[pchan->channelIndex];
+  unsigned int seq;
+
+  do {
+    seq = READ_ONCE(lt->seq);
+    smp_rmb();
+    *dst = *lt;
+    smp_rmb();
+  } while ((seq & 1) || (READ_ONCE(lt->seq) != seq));
+}
+
+/*
+ * notifyLocked -
+ *
+ * Signal the bound eventfd and SIGIO owners.
+ * This routine must be called with the board lock HELD.
+ */
+static void notifyLocked(counter_channel_t *pchan, int band)
+{
+  if (pchan->eventfd) {
+    eventfd_signal(pchan->eventfd, 1);
+  }
+  kill_fasync(&pchan->fasync, SIGIO, band);
+}
+
 /*
  * ringbufPushLocked -
  *
  * Update write index after setting element in place.
  * This routine must be called with the device lock HELD.
  */
-static bool ringbufPushLocked(counter_channel_t *pchan, int32_t counter)
+static bool ringbufPushLocked(counter_channel_t *pchan, int32_t counter, uint32_t timestamp, uint16_t flags)
 {
-  int tmpIndex, frameCountTmp;
+  uint16_t frameCount = (uint16_t)frameCountGet(pchan);
   bool  rv;
 
-  if (! CIRC_SPACE(pchan->ring.head, pchan->ring.tail, _ringSize)) {
+  /* the frame counter only advances for records that make it in */
+  rv = ctrRingPush(&pchan->ring, counter, timestamp, frameCount, flags);
 
-    /* buffer full! update the overflow counter */
+  /* buffer full! update the overflow counter before it is published */
+  if (!rv) {
     overflowCountIncrement(pchan);
-    rv = false;
+  }
 
-  } else {
+  /* pulse encoder records carry an interrupt mask, not a position */
+  if (!(flags & APCI1710CTR_FLAG_PULSEENC)) {
+    latestUpdateLocked(pchan, counter, timestamp, frameCount, flags);
+  }
 
-    tmpIndex = (pchan->ring.head + 1) % _ringSize;
+  if (!rv) {
 
-    /* get and update the frame counter (does this belong here?) */
-    frameCountTmp = frameCountGet(pchan);
-    frameCountIncrement(pchan);
+    if (pchan->overflowArmed) {
+      pchan->overflowArmed = false;
+      notifyLocked(pchan, POLL_ERR);
+    }
+
+    /* POLLPRI for pollers */
+    if (exceptionRaiseLocked(pchan, APCI1710CTR_EXC_OVERFLOW, NULL)) {
+      wake_up_interruptible(&pchan->inq);
+    }
 
-    /* update the element */
-    pchan->ringBuf[tmpIndex].counter = counter;
-    pchan->ringBuf[tmpIndex].frameCount = (uint16_t)frameCountTmp;
+  } else {
 
-    /* update the head index */
-    pchan->ring.head = tmpIndex;
+    frameCountIncrement(pchan);
 
-    /* wake up any waiters */
-    wake_up_interruptible(&pchan->inq);
+    /* wake up any waiters, now or from the fault timer */
+    if (!faultWakeDelayLocked(pchan)) {
+      wake_up_interruptible(&pchan->inq);
+
+      if (pchan->readyArmed) {
+        pchan->readyArmed = false;
+        notifyLocked(pchan, POLL_IN);
+      }
+    }
 
-    rv = true;
   }
+
+  /* independent of the channel ring, which nobody may be reading */
+  allbufPushLocked(pchan, counter, timestamp, flags);
+
   return rv;
 }
 
@@ -1326,24 +3814,15 @@ static bool ringbufPushLocked(counter_channel_t *pchan, int32_t counter)
  * Update read index after retrieving the element.
  * This routine must be called with the device lock NOT held.
  */
-static bool ringbufPop(counter_channel_t *pchan, int32_t *counter, uint16_t *frameCount, uint16_t *flags, uint32_t *timestamp)
+static bool ringbufPop(counter_channel_t *pchan, counterBuf_t *el)
 {
-  int   tmpIndex;
   unsigned long irqstate;
-  bool  rv = false;
+  bool  rv;
 
   apci1710_lock(pchan->pdev, &irqstate);
-
-  if (pchan->ring.head != pchan->ring.tail) {
-    /* copy data */
-    tmpIndex = (pchan->ring.tail + 1) % _ringSize;
-    *counter = pchan->ringBuf[tmpIndex].counter;
-    *frameCount = pchan->ringBuf[tmpIndex].frameCount;
-
-    /* update read index */
-    pchan->ring.tail = tmpIndex;
-    rv = true;
-  }
+  rv = ctrRingPop(&pchan->ring, el);
+  pchan->readyArmed = (pchan->ring.head == pchan->ring.tail);
+  pchan->overflowArmed = true;
   apci1710_unlock(pchan->pdev, irqstate);
 
   return rv;
@@ -1352,6 +3831,8 @@ static bool ringbufPop(counter_channel_t *pchan, int32_t *counter, uint16_t *fra
 /*
  * ringbufReset -
  *
+ * Empty the ring and clear the counts that describe it, in one lock hold
+ * so that a push from the ISR sees either the old stream or the new one.
  * This routine must be called with the device lock NOT held.
  */
 void ringbufReset(counter_channel_t *pchan)
@@ -1359,7 +3840,11 @@ void ringbufReset(counter_channel_t *pchan)
   unsigned long irqstate;
 
   apci1710_lock(pchan->pdev, &irqstate);
-  pchan->ring.head = pchan->ring.tail = 0;
+  frameCountClear(pchan);
+  overflowCountClear(pchan);
+  interruptCountClear(pchan);
+  ctrRingReset(&pchan->ring);
+  pchan->readyArmed = pchan->overflowArmed = true;
   apci1710_unlock(pchan->pdev, irqstate);
 }
 
@@ -22,4 +22,16 @@
 /* verbose 1=on, 0=off */
 #define APCI1710CTR_VERBOSE_DEFAULT 0
 
+/* open resets the channel 1=on, 0=attach to the running stream */
+#define APCI1710CTR_OPENRESET_DEFAULT 1
+
+/* APCI1710CTR_IOCINJECT 1=allowed, 0=refused */
+#define APCI1710CTR_INJECT_DEFAULT  0
+
+/* /proc counter reads reuse a value up to this old (us), 0=always read the board */
+#define APCI1710CTR_PROCMAXAGE_DEFAULT  0
+
+/* fault injection, APCI1710CTR_DEBUG builds only: every Nth, 0=off */
+#define APCI1710CTR_FAULT_DEFAULT   0
+
 #endif
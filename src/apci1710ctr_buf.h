@@ -12,4 +12,98 @@ typedef struct counterBuf {
     unsigned short  flags;
 } counterBuf_t;
 
+/*
+ * timestamp is in microseconds on the CPU monotonic clock (wraps every
+ * ~71 min).  With APCI1710CTR_FLAG_CHRONO it was advanced from the
+ * previous record's by the period the paired chronometer measured, so
+ * intervals between such records are board-clocked; without it, it is
+ * the CPU time, which is also where the board-clocked time starts over
+ * after an overflow or a missed measurement (see counterChrono_t).
+ */
+#define APCI1710CTR_FLAG_CHRONO     0x0001
+
+/*
+ * pulse encoder run-down event: counter holds the interrupt mask reported
+ * by the pulse encoder module rather than a latched counter value.
+ */
+#define APCI1710CTR_FLAG_PULSEENC   0x0002
+
+/*
+ * capture group member: counter was software-latched together with the
+ * other group members and timestamp holds the group sequence number
+ * shared by all of them.  The capture time and inter-board skew for each
+ * sequence number are reported by APCI1710CTR_IOCGETGROUP.
+ */
+#define APCI1710CTR_FLAG_GROUP      0x0004
+
+/*
+ * synthetic event from APCI1710CTR_IOCINJECT: nothing was latched, the
+ * record went through the same push, statistics and wakeup path as a
+ * latch interrupt.
+ */
+#define APCI1710CTR_FLAG_INJECT     0x0008
+
+/*
+ * recorded event from APCI1710CTR_IOCREPLAY: counter and the other flags
+ * are as recorded, timestamp is the time it was queued again.
+ */
+#define APCI1710CTR_FLAG_REPLAY     0x0010
+
+/*
+ * record read from the aggregated /dev/apci1710ctr_all stream
+ *
+ * rec.frameCount counts the events each channel offered to the aggregated
+ * stream since it was opened, so a gap means records were lost there.
+ */
+typedef struct counterAllBuf {
+    counterBuf_t    rec;
+    unsigned int    channel;        /* minor number of the source channel */
+} counterAllBuf_t;
+
+/*
+ * latest-value page, mapped read-only by mmap() on any channel device
+ *
+ * One page per board, indexed by module number.  The driver updates an
+ * entry on every event; seq is odd while the update is in progress.
+ * Readers retry until they see the same even seq before and after
+ * copying the entry, see counterLatestRead().
+ */
+#define APCI1710CTR_LATEST_VERSION  1
+
+typedef struct counterLatest {
+    volatile unsigned int   seq;
+    int                     counter;        /* latest latched value */
+    unsigned int            timestamp;      /* as in counterBuf_t */
+    unsigned short          frameCount;
+    unsigned short          flags;
+    unsigned int            interruptCount;
+    unsigned int            overflowCount;
+    unsigned long long      time;           /* CLOCK_MONOTONIC ns of the update */
+} counterLatest_t;
+
+typedef struct counterLatestPage {
+    unsigned int    version;        /* APCI1710CTR_LATEST_VERSION */
+    unsigned int    board;
+    unsigned int    channels;       /* entries in channel[] */
+    unsigned int    reserved;
+    counterLatest_t channel[4];
+} counterLatestPage_t;
+
+#ifndef __KERNEL__
+/* consistent copy of one entry of a mapped latest-value page */
+static inline void counterLatestRead(const counterLatest_t *src, counterLatest_t *dst)
+{
+    unsigned int seq;
+
+    do {
+        while ((seq = src->seq) & 1) {
+            ;
+        }
+        __sync_synchronize();
+        *dst = *(const counterLatest_t *)src;
+        __sync_synchronize();
+    } while (src->seq != seq);
+}
+#endif
+
 #endif
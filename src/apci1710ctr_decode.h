@@ -0,0 +1,73 @@
+/* apci1710ctr_decode.h */
+
+/*
+ * Latch interrupt decode for capture group members, shared by the driver
+ * and the user-space test in tools/.  It does no locking of its own: in
+ * the driver the callers hold the board lock.
+ *
+ * A group capture latches each member into latch register 1 by software
+ * and pushes the value itself, but the software latch raises a latch
+ * interrupt too, which the interrupt routine has to recognize and drop
+ * without mistaking a hardware latch on register 0 for it.
+ */
+
+#ifndef __INC_apci1710ctr_decode
+#define __INC_apci1710ctr_decode
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#include <stdbool.h>
+#endif
+
+/* latch register status bits, as i_APCI1710_ReadLatchRegisterStatus() */
+#define CTR_LATCH_SOFTWARE    1
+#define CTR_LATCH_HARDWARE    2
+
+/* read, and so clear, the status of latch register reg; nonzero on error */
+typedef int (*ctrLatchStatusFn)(void *ctx, uint8_t reg, uint8_t *status);
+
+/*
+ * ctrGroupDecode -
+ *
+ * Whether the latch interrupt being handled is a group software latch,
+ * already pushed by the group, rather than an event.  Register 0 is read
+ * on every interrupt of a member, so its hardware bit is never left over
+ * from an earlier event; register 1 is only read while a software latch
+ * is outstanding.  When neither shows a latch the outstanding count was
+ * wrong, and it starts over.
+ */
+static inline bool ctrGroupDecode(unsigned int *groupPending, ctrLatchStatusFn readStatus, void *ctx)
+{
+  uint8_t status;
+
+  if (!readStatus(ctx, 0, &status) && (status & CTR_LATCH_HARDWARE)) {
+    return false;
+  }
+  if (!*groupPending) {
+    return false;
+  }
+  if (!readStatus(ctx, 1, &status) && (status & CTR_LATCH_SOFTWARE)) {
+    (*groupPending)--;
+    return true;
+  }
+  *groupPending = 0;
+  return false;
+}
+
+/*
+ * ctrGroupResync -
+ *
+ * After a capture has read latch register 1: the register holds one
+ * latch, so however many captures ran since the interrupt routine last
+ * saw one, at most one interrupt is outstanding.
+ */
+static inline void ctrGroupResync(unsigned int *groupPending)
+{
+  if (*groupPending > 1) {
+    *groupPending = 1;
+  }
+}
+
+#endif /* __INC_apci1710ctr_decode */
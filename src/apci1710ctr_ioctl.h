@@ -12,4 +12,242 @@
 #define APCI1710CTR_IOCINTDISABLE   _IO(APCI1710CTR_IOC_MAGIC, 2)
 #define APCI1710CTR_IOCSETINPUTFILTER _IO(APCI1710CTR_IOC_MAGIC, 3)
 
+/*
+ * pair a counter channel with a chronometer module (module -1 = unpair).
+ * The chronometer input must be wired to the latch trigger of the channel
+ * and chronoMode should be 0 or 1 (period measurement): each record's
+ * timestamp is then the previous one plus the measured period, counted in
+ * timingInterval timingUnits (nominal, under 2^32 ns each), and has
+ * APCI1710CTR_FLAG_CHRONO.  The first record, and any after an overflow
+ * or a period that disagrees with the CPU clock (a missed trigger), takes
+ * the CPU time instead and does not have the flag.  A module is paired
+ * with one channel at a time (EBUSY).
+ */
+typedef struct counterChrono {
+    int             module;         /* chronometer module (0 to 3) */
+    unsigned int    chronoMode;     /* i_APCI1710_InitChrono mode (0 to 7) */
+    unsigned int    timingUnit;     /* 0=ns, 1=us, 2=ms, 3=s, 4=mn */
+    unsigned int    timingInterval; /* base timing value */
+} counterChrono_t;
+
+#define APCI1710CTR_IOCSETCHRONO    _IOW(APCI1710CTR_IOC_MAGIC, 4, counterChrono_t)
+
+/* drive a pulse encoder from a counter channel (module -1 = disable) */
+typedef struct counterPulseEnc {
+    int             module;         /* pulse encoder module (0 to 3) */
+    unsigned int    encoder;        /* pulse encoder (0 to 3) */
+    unsigned int    inputLevel;     /* 0=count low pulses, 1=count high pulses */
+    unsigned int    triggerAction;  /* 0=none, 1=output high, 2=output low on run-down */
+    unsigned int    startValue;     /* divide-by or preload count (1 to 4294967295) */
+    unsigned int    continuous;     /* 1=reload start value after run-down */
+    unsigned int    interrupt;      /* 1=report run-down events in the ring */
+} counterPulseEnc_t;
+
+typedef struct counterPulseEncStatus {
+    unsigned int    value;          /* current pulse encoder value */
+    unsigned int    overflow;       /* 1=run-down occurred */
+} counterPulseEncStatus_t;
+
+#define APCI1710CTR_IOCSETPULSEENC    _IOW(APCI1710CTR_IOC_MAGIC, 5, counterPulseEnc_t)
+#define APCI1710CTR_IOCWRITEPULSEENC  _IOW(APCI1710CTR_IOC_MAGIC, 6, unsigned int)
+#define APCI1710CTR_IOCGETPULSEENC    _IOR(APCI1710CTR_IOC_MAGIC, 7, counterPulseEncStatus_t)
+
+/* scheduled digital output pulse triggers */
+#define APCI1710CTR_DIGOUT_CANCEL       0   /* cancel any pending pulse */
+#define APCI1710CTR_DIGOUT_ABSOLUTE     1   /* start at time (CLOCK_MONOTONIC ns) */
+#define APCI1710CTR_DIGOUT_RELATIVE     2   /* start delay ns from now */
+#define APCI1710CTR_DIGOUT_AFTERLATCH   3   /* start delay ns after the next latch event */
+
+typedef struct counterDigoutPulse {
+    unsigned long long  time;       /* ABSOLUTE start time (ns) */
+    unsigned long long  delay;      /* RELATIVE/AFTERLATCH delay (ns) */
+    unsigned long long  width;      /* pulse width (ns), 0 = single edge */
+    unsigned int        trigger;    /* APCI1710CTR_DIGOUT_* */
+    unsigned int        level;      /* output level during the pulse (0 or 1) */
+    unsigned int        repeat;     /* AFTERLATCH: rearm after each pulse */
+    int                 module;     /* AFTERLATCH: EL timer module, -1 = hrtimer */
+} counterDigoutPulse_t;
+
+/*
+ * With an EL timer module, delay and width are limited to 2^32 - 1 steps
+ * of 100 ns (EINVAL) and the module must not be in use by another
+ * channel (EBUSY).  Replacing or cancelling a pulse in its width ends it.
+ */
+
+#define APCI1710CTR_IOCDIGOUTPULSE    _IOW(APCI1710CTR_IOC_MAGIC, 8, counterDigoutPulse_t)
+
+/*
+ * in-kernel threshold reflex (count 0 = disable)
+ *
+ * Region n holds the latched values with exactly n thresholds less than
+ * or equal to them.  On entering region n the digital output is set to
+ * bit n of levels, e.g. thresholds {lo, hi} with levels 0x2 turns the
+ * output on inside the window [lo, hi).
+ */
+#define APCI1710CTR_REFLEX_MAX  8
+
+typedef struct counterReflex {
+    int             threshold[APCI1710CTR_REFLEX_MAX];  /* strictly ascending */
+    unsigned int    count;          /* number of thresholds in use */
+    unsigned int    levels;         /* bit n = output level in region n */
+    int             module;         /* digital output module, -1 = this channel */
+} counterReflex_t;
+
+#define APCI1710CTR_IOCSETREFLEX      _IOW(APCI1710CTR_IOC_MAGIC, 9, counterReflex_t)
+
+/*
+ * capture group (count 0 = dissolve)
+ *
+ * One group per driver.  Members are channels by minor number and may be
+ * on different boards.  Each capture software-latches all members back
+ * to back and pushes one APCI1710CTR_FLAG_GROUP record per member.
+ */
+#define APCI1710CTR_GROUP_MAX       16
+#define APCI1710CTR_GROUP_HISTORY   16
+
+typedef struct counterGroup {
+    unsigned int        minor[APCI1710CTR_GROUP_MAX];   /* member channels */
+    unsigned int        count;      /* number of members */
+    unsigned long long  period;     /* capture period (ns), 0 = IOCGROUPTRIGGER only */
+} counterGroup_t;
+
+typedef struct counterGroupCapture {
+    unsigned int        seq;        /* sequence number in the member records */
+    unsigned int        timestamp;  /* CPU monotonic clock (us) at the capture */
+    unsigned int        skew;       /* first to last member latch (ns) */
+    unsigned int        members;    /* members latched successfully */
+} counterGroupCapture_t;
+
+typedef struct counterGroupStatus {
+    unsigned long long      captures;   /* captures since the group was set */
+    unsigned int            maxSkew;    /* largest skew seen (ns) */
+    unsigned int            count;      /* number of entries in history */
+    counterGroupCapture_t   history[APCI1710CTR_GROUP_HISTORY]; /* newest first */
+} counterGroupStatus_t;
+
+#define APCI1710CTR_IOCSETGROUP       _IOW(APCI1710CTR_IOC_MAGIC, 10, counterGroup_t)
+#define APCI1710CTR_IOCGROUPTRIGGER   _IO(APCI1710CTR_IOC_MAGIC, 11)
+#define APCI1710CTR_IOCGETGROUP       _IOR(APCI1710CTR_IOC_MAGIC, 12, counterGroupStatus_t)
+
+/*
+ * binary statistics
+ *
+ * /proc/driver/apci1710ctr/stats holds one counterStatsHeader_t followed
+ * by header.channels entries of header.channelSize bytes, one per counter
+ * channel.  New fields are only ever appended, so readers should step by
+ * channelSize rather than sizeof(counterStatsChannel_t).
+ * APCI1710CTR_IOCGETSTATS returns the entry for the channel of the fd.
+ * Both are built from driver state only, without touching the board.
+ */
+#define APCI1710CTR_STATS_VERSION       1
+#define APCI1710CTR_STATS_HISTO_BINS    20
+
+#define APCI1710CTR_STATS_INTENABLED    0x0001  /* latch interrupt enabled */
+#define APCI1710CTR_STATS_HISTOENABLED  0x0002  /* trigger interval histogram running */
+#define APCI1710CTR_STATS_IGNOREENABLED 0x0004  /* intervals under 8 ms are ignored */
+
+typedef struct counterStatsHeader {
+    unsigned int    version;        /* APCI1710CTR_STATS_VERSION */
+    unsigned int    headerSize;     /* sizeof(counterStatsHeader_t) */
+    unsigned int    channelSize;    /* size of each channel entry */
+    unsigned int    channels;       /* number of channel entries */
+} counterStatsHeader_t;
+
+typedef struct counterStatsChannel {
+    unsigned int    minor;
+    unsigned int    flags;          /* APCI1710CTR_STATS_* */
+    unsigned int    interruptCount;
+    unsigned int    frameCount;
+    unsigned int    overflowCount;
+    unsigned int    ringSize;       /* capacity is ringSize - 1 records */
+    unsigned int    ringLevel;
+    unsigned int    ringHighWater;  /* highest level since the last reset */
+    int             mode;
+    int             hysteresis;
+    int             filter;
+    int             chronoModule;   /* -1 = none */
+    int             pulseEncModule; /* -1 = none */
+    int             elModule;       /* -1 = none */
+    unsigned int    reflexCount;
+    int             reflexRegion;   /* -1 = unknown */
+    unsigned int    ignoreCount;
+    unsigned int    histo[APCI1710CTR_STATS_HISTO_BINS];    /* trigger interval (ms) */
+} counterStatsChannel_t;
+
+#define APCI1710CTR_IOCGETSTATS       _IOR(APCI1710CTR_IOC_MAGIC, 13, counterStatsChannel_t)
+
+/*
+ * bind an eventfd to the channel (-1 = unbind)
+ *
+ * The eventfd is signalled once when records arrive in an empty ring,
+ * and not again until a read has emptied it, so one signal covers a whole
+ * batch; readers should drain until EAGAIN.  Overflow is signalled once
+ * until the next read.  SIGIO (fcntl F_SETFL O_ASYNC) follows the same
+ * rules, with POLL_IN and POLL_ERR.  The binding is dropped when the fd
+ * that made it is closed.
+ */
+#define APCI1710CTR_IOCSETEVENTFD     _IOW(APCI1710CTR_IOC_MAGIC, 14, int)
+
+/*
+ * channel exceptions
+ *
+ * Exceptions are kept per fd and are off until the fd first calls
+ * APCI1710CTR_IOCGETEXCEPTIONS, which returns the bits set since the
+ * previous call and clears them (0 on the first call).  From then on
+ * poll() reports POLLPRI while APCI1710CTR_EXC_OVERFLOW is set and
+ * POLLERR while any of the others is.  Changes made through the fd
+ * itself (APCI1710CTR_IOCRESET, APCI1710CTR_IOCINTDISABLE, configuration
+ * ioctls, open with openreset=1) are reported to the other fds only.
+ */
+#define APCI1710CTR_EXC_OVERFLOW      0x0001  /* ring overflowed, records lost */
+#define APCI1710CTR_EXC_INTDISABLED   0x0002  /* latch interrupt was disabled */
+#define APCI1710CTR_EXC_RESET         0x0004  /* ring and counts were reset */
+#define APCI1710CTR_EXC_RECONFIG      0x0008  /* input configuration changed */
+
+#define APCI1710CTR_IOCGETEXCEPTIONS  _IOR(APCI1710CTR_IOC_MAGIC, 15, unsigned int)
+
+/*
+ * synthetic event injection, for load testing the data path
+ *
+ * Queues count records flagged APCI1710CTR_FLAG_INJECT at rate per
+ * second from an hrtimer, with counter values counter, counter + step,
+ * ...  A new request replaces a running one and count 0 stops it, as does
+ * APCI1710CTR_IOCRESET.  Fails with EPERM unless the module was loaded
+ * with inject=1 and the caller has CAP_SYS_ADMIN.
+ */
+#define APCI1710CTR_INJECT_RATE_MAX   1000000
+
+typedef struct counterInject {
+    unsigned int    count;          /* records to queue, 0 = stop */
+    unsigned int    rate;           /* records per second (1 to APCI1710CTR_INJECT_RATE_MAX) */
+    int             counter;        /* counter value of the first record */
+    int             step;           /* added for each following record */
+} counterInject_t;
+
+#define APCI1710CTR_IOCINJECT         _IOW(APCI1710CTR_IOC_MAGIC, 16, counterInject_t)
+
+/*
+ * replay of recorded events, for load and regression testing consumers
+ *
+ * Queues count records from the counterBuf_t array at events, spaced as
+ * their timestamps were (microsecond differences, modulo 2^32) divided
+ * by speed, from an hrtimer.  Each record keeps its counter value and
+ * flags, gets APCI1710CTR_FLAG_REPLAY and the current time as timestamp,
+ * and goes through the same push, statistics and wakeup path as a latch
+ * interrupt, so recorded bursts overflow the ring as they did live.  The
+ * events are copied before the call returns.  A new request replaces a
+ * running one and count 0 stops it, as does APCI1710CTR_IOCRESET.  Same
+ * permissions as APCI1710CTR_IOCINJECT.
+ */
+#define APCI1710CTR_REPLAY_MAX        (1 << 20)
+#define APCI1710CTR_REPLAY_SPEED_MAX  1000
+
+typedef struct counterReplay {
+    unsigned long long  events;     /* user address of count counterBuf_t */
+    unsigned int        count;      /* records to queue (up to APCI1710CTR_REPLAY_MAX), 0 = stop */
+    unsigned int        speed;      /* 1 = recorded timing, N = N times faster (up to APCI1710CTR_REPLAY_SPEED_MAX) */
+} counterReplay_t;
+
+#define APCI1710CTR_IOCREPLAY         _IOW(APCI1710CTR_IOC_MAGIC, 17, counterReplay_t)
+
 #endif
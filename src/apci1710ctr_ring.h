@@ -0,0 +1,214 @@
+/* apci1710ctr_ring.h */
+
+/*
+ * Event ring and interval histogram shared by the driver and the
+ * user-space benchmark in tools/.  Everything here is inline and does no
+ * locking of its own: in the driver the callers hold the board lock.
+ */
+
+#ifndef __INC_apci1710ctr_ring
+#define __INC_apci1710ctr_ring
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/bug.h>
+#include <linux/circ_buf.h>
+#else
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#define CIRC_CNT(head,tail,size) (((head) - (tail)) & ((size)-1))
+#define CIRC_SPACE(head,tail,size) CIRC_CNT((tail),((head)+1),(size))
+#endif
+
+/*
+ * invariant checks, compiled in with APCI1710CTR_DEBUG
+ * (make APCI1710CTR_DEBUG=y in a platform directory)
+ */
+#ifdef APCI1710CTR_DEBUG
+#ifdef __KERNEL__
+#define CTR_CHECK(cond) WARN_ON_ONCE(!(cond))
+#else
+#define CTR_CHECK(cond) assert(cond)
+#endif
+#else
+#define CTR_CHECK(cond) do { } while (0)
+#endif
+
+#include "apci1710ctr_buf.h"
+#include "apci1710ctr_ioctl.h"
+
+/*
+ * ring buffer
+ *
+ * The buffer's full or empty state can be resolved from the read and write pointers.
+ * When the ptrs are equal, the buffer is empty.
+ * When the read ptr is one greater than the write ptr, the buffer is full.
+ * The capacity of the buffer is (size - 1) elements; size is a power of 2.
+ */
+
+typedef struct {
+  counterBuf_t *  buf;
+  unsigned int    size;
+  unsigned int    head;
+  unsigned int    tail;
+  unsigned int    highWater;        /* highest level since the last reset */
+} ctrRing_t;
+
+static inline void ctrRingInit(ctrRing_t *ring, counterBuf_t *buf, unsigned int size)
+{
+  CTR_CHECK((size >= 2) && !(size & (size - 1)));
+  ring->buf = buf;
+  ring->size = size;
+  ring->head = ring->tail = 0;
+  ring->highWater = 0;
+}
+
+static inline unsigned int ctrRingLevel(const ctrRing_t *ring)
+{
+  return CIRC_CNT(ring->head, ring->tail, ring->size);
+}
+
+static inline void ctrRingReset(ctrRing_t *ring)
+{
+  ring->head = ring->tail = 0;
+  ring->highWater = 0;
+}
+
+/*
+ * ctrRingPush -
+ *
+ * Update write index after setting element in place.
+ * Returns false, leaving the ring untouched, when it is full.
+ * frameCount must follow on from the newest record in the ring.
+ */
+static inline bool ctrRingPush(ctrRing_t *ring, int32_t counter, uint32_t timestamp,
+                               uint16_t frameCount, uint16_t flags)
+{
+  unsigned int tmpIndex, level;
+
+  CTR_CHECK((ring->head < ring->size) && (ring->tail < ring->size));
+  CTR_CHECK(ctrRingLevel(ring) <= ring->highWater);
+
+  if (! CIRC_SPACE(ring->head, ring->tail, ring->size)) {
+    /* full and empty are told apart by the one slot that is never used */
+    CTR_CHECK(ctrRingLevel(ring) == ring->size - 1);
+    return false;
+  }
+  CTR_CHECK((ring->head == ring->tail) ||
+            ((uint16_t)(ring->buf[ring->head].frameCount + 1) == frameCount));
+
+  tmpIndex = (ring->head + 1) % ring->size;
+
+  /* update the element */
+  ring->buf[tmpIndex].counter = counter;
+  ring->buf[tmpIndex].frameCount = frameCount;
+  ring->buf[tmpIndex].timestamp = timestamp;
+  ring->buf[tmpIndex].flags = flags;
+
+  /* update the head index */
+  ring->head = tmpIndex;
+  level = CIRC_CNT(ring->head, ring->tail, ring->size);
+  if (level > ring->highWater) {
+    ring->highWater = level;
+  }
+  return true;
+}
+
+/*
+ * ctrRingPop -
+ *
+ * Update read index after retrieving the element.
+ */
+static inline bool ctrRingPop(ctrRing_t *ring, counterBuf_t *el)
+{
+  unsigned int tmpIndex;
+
+  CTR_CHECK((ring->head < ring->size) && (ring->tail < ring->size));
+
+  if (ring->head == ring->tail) {
+    return false;
+  }
+  CTR_CHECK(CIRC_SPACE(ring->head, ring->tail, ring->size) < ring->size - 1);
+  tmpIndex = (ring->tail + 1) % ring->size;
+  *el = ring->buf[tmpIndex];
+  ring->tail = tmpIndex;
+  return true;
+}
+
+/*
+ * interval histogram
+ *
+ * Bin n counts latch intervals of n ticks, the last bin everything
+ * longer.  With ignoreEnabled, intervals under CTR_STAT_IGNORE_TICKS are
+ * counted in ignoreCount instead and do not restart the interval.
+ */
+
+#define CTR_STAT_HISTO_BINS   APCI1710CTR_STATS_HISTO_BINS
+#define CTR_STAT_IGNORE_TICKS 8
+
+typedef struct {
+  int histo[CTR_STAT_HISTO_BINS];
+  bool histoEnabled;
+  bool first;
+  unsigned long prev_jiffies;
+  bool ignoreEnabled;
+  long ignoreCount;
+} ctrStat_t;
+
+static inline void ctrStatStart(ctrStat_t *st)
+{
+  st->first = true;
+  st->histoEnabled = true;
+}
+
+static inline void ctrStatStop(ctrStat_t *st)
+{
+  st->histoEnabled = false;
+}
+
+static inline void ctrStatReset(ctrStat_t *st)
+{
+  int jj;
+  for (jj = 0; jj < CTR_STAT_HISTO_BINS; jj++) {
+    st->histo[jj] = 0;
+  }
+  st->ignoreCount = 0;
+}
+
+/*
+ * ctrStatSample -
+ *
+ * Account one event at tick now.  Returns the interval in ticks, 0 for
+ * the first event, or a negative interval when now went backwards, which
+ * is not counted.
+ */
+static inline long ctrStatSample(ctrStat_t *st, unsigned long now)
+{
+  long diffy;
+
+  if (!st->histoEnabled) {
+    return 0;
+  }
+  if (st->first) {
+    st->prev_jiffies = now;
+    st->first = false;
+    return 0;
+  }
+  diffy = (long)(now - st->prev_jiffies);
+  if (diffy < 0) {
+    return diffy;
+  }
+  if (diffy < CTR_STAT_IGNORE_TICKS && st->ignoreEnabled) {
+    /* IGNORE short trigger interval */
+    ++ st->ignoreCount;
+  } else {
+    /* fill histogram, the last bin includes all higher values */
+    ++ st->histo[(diffy < CTR_STAT_HISTO_BINS-1) ? diffy : CTR_STAT_HISTO_BINS-1];
+    st->prev_jiffies = now;
+  }
+  return diffy;
+}
+
+#endif /* __INC_apci1710ctr_ring */
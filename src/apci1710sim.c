@@ -0,0 +1,932 @@
+/**
+ * ----------------------------------------------------------------------------
+ * File       : apci1710sim.c
+ * Created    : 2026-10-19
+ * ----------------------------------------------------------------------------
+ * Description:
+ * Simulated APCI-1710 board.  Exports the part of the ADDI-DATA kAPI that
+ * apci1710ctr uses, so that the counter driver can be loaded and exercised
+ * without hardware.  Load it instead of the vendor module, never together.
+ *
+ * Each board has four modules, incremental counters unless the
+ * functionality parameter says otherwise.  A counter module counts a
+ * quadrature signal of velocity lines per second and is latched latchrate
+ * times per second, burst latches at a time, from an hrtimer; latches are
+ * delivered to the registered interrupt routine with the board lock held,
+ * as the real driver does.  velocity, latchrate and burst may be changed
+ * at any time through /sys/module/apci1710sim/parameters.
+ *
+ * A chronometer module has its input wired to the hardware latch trigger
+ * of counter module chronotrigger: each trigger ends the measurement of
+ * the period since the previous one and starts the next, which is what
+ * i_APCI1710_ReadChronoValue() then reports.
+ * ----------------------------------------------------------------------------
+ * This file is part of apci1710ctrDriver. It is subject to
+ * the license terms in the LICENSE.txt file found in the top-level directory
+ * of this distribution and at:
+ *   https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of apci1710ctrDriver, including this file, may be
+ * copied, modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+**/
+
+#include <linux/version.h>
+#include <linux/spinlock.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/pci.h>    // struct pci_dev
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+
+#include "apci1710.h"
+#include "apci1710-kapi.h"
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("SLAC");
+MODULE_DESCRIPTION("APCI-1710 simulator");
+
+#define SIM_MAX_BOARDS    8
+#define SIM_NUM_MODULES   4
+#define SIM_IDLE_PERIOD   (10 * NSEC_PER_MSEC)    /* latchrate 0: look again later */
+
+static const char modulename[] = "apci1710sim";
+
+static int boards = 1;
+module_param(boards, int, 0444);
+MODULE_PARM_DESC(boards, "Number of simulated boards (1 to 8)");
+
+static unsigned int functionality[SIM_NUM_MODULES] = {
+  APCI1710_INCREMENTAL_COUNTER, APCI1710_INCREMENTAL_COUNTER,
+  APCI1710_INCREMENTAL_COUNTER, APCI1710_INCREMENTAL_COUNTER
+};
+module_param_array(functionality, uint, NULL, 0444);
+MODULE_PARM_DESC(functionality, "Module functionality per slot (0x5343=counter, 0x4348=chronometer, 0x495A=pulse encoder, 0x454C=EL timers)");
+
+static int velocity[SIM_NUM_MODULES] = { 1000, 1000, 1000, 1000 };
+module_param_array(velocity, int, NULL, 0644);
+MODULE_PARM_DESC(velocity, "Quadrature signal per slot (lines/s, negative counts down)");
+
+static unsigned int latchrate[SIM_NUM_MODULES] = { 10, 10, 10, 10 };
+module_param_array(latchrate, uint, NULL, 0644);
+MODULE_PARM_DESC(latchrate, "Hardware latch events per slot (Hz, 0=none)");
+
+static unsigned int burst[SIM_NUM_MODULES] = { 1, 1, 1, 1 };
+module_param_array(burst, uint, NULL, 0644);
+MODULE_PARM_DESC(burst, "Back to back latch events per latch period");
+
+static int chronotrigger[SIM_NUM_MODULES] = { 0, 0, 0, 0 };
+module_param_array(chronotrigger, int, NULL, 0644);
+MODULE_PARM_DESC(chronotrigger, "Counter slot whose latch trigger drives each chronometer slot (-1=none)");
+
+struct sim_board;
+
+typedef struct {
+  unsigned int      index;
+  struct sim_board *board;
+  uint32_t          functionality;
+
+  /* incremental counter */
+  bool              initialized;
+  int               modeFactor;     /* counts per line: 1, 2 or 4 */
+  s64               count;
+  s64               remainder;      /* count * NSEC_PER_SEC not yet whole */
+  ktime_t           last;           /* time count was brought up to */
+  uint32_t          latch[2];
+  uint8_t           latchStatus[2]; /* 1 = software, 2 = hardware latch */
+  uint8_t           pending;        /* bit n = latch register n interrupt */
+  bool              latchInt;
+  bool              digout;
+  uint8_t           filter;
+  struct hrtimer    timer;          /* hardware latch generator */
+
+  /* chronometer */
+  bool              chronoInit;
+  bool              chronoEnabled;
+  u64               chronoUnit;     /* ns per chronometer count */
+  ktime_t           chronoStart;    /* of the measurement in progress */
+  uint8_t           chronoStatus;   /* as i_APCI1710_ReadChronoValue() */
+  uint32_t          chronoValue;    /* last measured period, in counts */
+
+  /* pulse encoder */
+  uint32_t          pulseEncValue[4];
+
+  /* EL timers */
+  bool              elInit;
+} sim_module_t;
+
+typedef struct sim_board {
+  struct pci_dev    pdev;           /* handle only, never a real PCI device */
+  spinlock_t        lock;           /* apci1710_get_lock() */
+  unsigned int      index;
+  void (*callback)(struct pci_dev *pdev);
+  sim_module_t      module[SIM_NUM_MODULES];
+  struct hrtimer    swTimer;        /* delivers software latch interrupts */
+} sim_board_t;
+
+static sim_board_t *simBoard;
+
+static sim_board_t *simBoardFromPdev(struct pci_dev *pdev)
+{
+  return pdev ? container_of(pdev, sim_board_t, pdev) : NULL;
+}
+
+/*
+ * simModule -
+ *
+ * Board and module number check shared by all kAPI calls; NULL and the
+ * kAPI error code (1 = bad handle, 2 = bad module) on failure.
+ */
+static sim_module_t *simModule(struct pci_dev *pdev, uint8_t b_ModulNbr, int *err)
+{
+  sim_board_t *board = simBoardFromPdev(pdev);
+
+  if (!board) {
+    *err = 1;
+    return NULL;
+  }
+  if (b_ModulNbr >= SIM_NUM_MODULES) {
+    *err = 2;
+    return NULL;
+  }
+  *err = 0;
+  return board->module + b_ModulNbr;
+}
+
+/* ===== quadrature counter ====================================== */
+
+/*
+ * simCountLocked -
+ *
+ * Bring the counter up to now.  Whole seconds are stepped one at a time
+ * so that velocity * factor * dt cannot overflow after a long idle spell.
+ * This routine must be called with the board lock HELD.
+ */
+static void simCountLocked(sim_module_t *mod, ktime_t now)
+{
+  s64 dt = ktime_to_ns(ktime_sub(now, mod->last));
+  s64 perSecond = (s64)velocity[mod->index] * mod->modeFactor;
+  s32 rem;
+
+  mod->last = now;
+  if (!mod->initialized || (dt <= 0)) {
+    return;
+  }
+  while (dt >= NSEC_PER_SEC) {
+    mod->count += perSecond;
+    dt -= NSEC_PER_SEC;
+  }
+  mod->remainder += perSecond * dt;
+  mod->count += div_s64_rem(mod->remainder, NSEC_PER_SEC, &rem);
+  mod->remainder = rem;
+}
+
+/*
+ * simDeliverLocked -
+ *
+ * Call the interrupt routine while latch interrupts are pending, the way
+ * the vendor interrupt handler does.  Each call consumes one through
+ * i_APCI1710_TestInterrupt().
+ * This routine must be called with the board lock HELD.
+ */
+static void simDeliverLocked(sim_board_t *board)
+{
+  int ii, budget = 2 * SIM_NUM_MODULES;
+  bool any;
+
+  do {
+    any = false;
+    for (ii = 0; ii < SIM_NUM_MODULES; ii++) {
+      any = any || board->module[ii].pending;
+    }
+    if (any && board->callback) {
+      board->callback(&board->pdev);
+    }
+  } while (any && board->callback && --budget);
+}
+
+/*
+ * simChronoTriggerLocked -
+ *
+ * An edge on the input of a chronometer: the first one starts a
+ * measurement, each later one stops it and starts the next.
+ * This routine must be called with the board lock HELD.
+ */
+static void simChronoTriggerLocked(sim_module_t *chrono, ktime_t now)
+{
+  u64 counts;
+
+  if (chrono->chronoStatus) {
+    counts = div64_u64(ktime_to_ns(ktime_sub(now, chrono->chronoStart)), chrono->chronoUnit);
+    if (counts > U32_MAX) {
+      chrono->chronoStatus = 3;
+      chrono->chronoValue = 0;
+    } else {
+      chrono->chronoStatus = 2;
+      chrono->chronoValue = (uint32_t)counts;
+    }
+  } else {
+    chrono->chronoStatus = 1;
+  }
+  chrono->chronoStart = now;
+}
+
+/* This routine must be called with the board lock HELD. */
+static void simLatchLocked(sim_module_t *mod, uint8_t reg, uint8_t source)
+{
+  ktime_t now = ktime_get();
+  sim_module_t *chrono;
+  int ii;
+
+  simCountLocked(mod, now);
+  mod->latch[reg] = (uint32_t)mod->count;
+  mod->latchStatus[reg] |= source;
+  if (mod->latchInt) {
+    mod->pending |= (1 << reg);
+  }
+
+  /* the hardware latch trigger also reaches the chronometers wired to it */
+  if (source == 2) {
+    for (ii = 0; ii < SIM_NUM_MODULES; ii++) {
+      chrono = &mod->board->module[ii];
+      if (chrono->chronoEnabled && (READ_ONCE(chronotrigger[ii]) == (int)mod->index)) {
+        simChronoTriggerLocked(chrono, now);
+      }
+    }
+  }
+}
+
+static enum hrtimer_restart simLatchTimer(struct hrtimer *timer)
+{
+  sim_module_t *mod = container_of(timer, sim_module_t, timer);
+  unsigned long irqstate;
+  unsigned int rate = READ_ONCE(latchrate[mod->index]);
+  unsigned int nn = rate ? max(READ_ONCE(burst[mod->index]), 1u) : 0;
+  unsigned int ii;
+
+  spin_lock_irqsave(&mod->board->lock, irqstate);
+  if (mod->initialized) {
+    for (ii = 0; ii < nn; ii++) {
+      simLatchLocked(mod, 0, 2);
+      simDeliverLocked(mod->board);
+    }
+  }
+  spin_unlock_irqrestore(&mod->board->lock, irqstate);
+
+  hrtimer_forward_now(timer, ns_to_ktime(rate ? div_u64(NSEC_PER_SEC, rate) : SIM_IDLE_PERIOD));
+  return HRTIMER_RESTART;
+}
+
+static enum hrtimer_restart simSwTimer(struct hrtimer *timer)
+{
+  sim_board_t *board = container_of(timer, sim_board_t, swTimer);
+  unsigned long irqstate;
+
+  spin_lock_irqsave(&board->lock, irqstate);
+  simDeliverLocked(board);
+  spin_unlock_irqrestore(&board->lock, irqstate);
+
+  return HRTIMER_NORESTART;
+}
+
+/* ===== quadrature counter === ^^^ ============================== */
+
+/* ===== kAPI ==================================================== */
+
+struct pci_dev * apci1710_lookup_board_by_index(unsigned int index)
+{
+  if (!simBoard || (index >= (unsigned int)boards)) {
+    return NULL;
+  }
+  return &simBoard[index].pdev;
+}
+EXPORT_SYMBOL(apci1710_lookup_board_by_index);
+
+spinlock_t * apci1710_get_lock(struct pci_dev *pdev)
+{
+  return &simBoardFromPdev(pdev)->lock;
+}
+EXPORT_SYMBOL(apci1710_get_lock);
+
+int i_APCI1710_ReadModulesConfiguration (struct pci_dev *pdev)
+{
+  return simBoardFromPdev(pdev) ? 0 : 1;
+}
+EXPORT_SYMBOL(i_APCI1710_ReadModulesConfiguration);
+
+int i_APCI1710_GetModuleId (struct pci_dev * pdev, uint8_t b_ModuleNbr, uint32_t * pui_ModuleId)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModuleNbr, &err);
+
+  if (mod) {
+    /* functionality, then the firmware version as two ASCII digits */
+    *pui_ModuleId = (mod->functionality << 16) | ('1' << 8) | '0';
+  }
+  return err;
+}
+EXPORT_SYMBOL(i_APCI1710_GetModuleId);
+
+int i_APCI1710_GetFunctionality (struct pci_dev * pdev, uint8_t b_ModuleNbr, uint32_t * pui_Functionality)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModuleNbr, &err);
+
+  if (mod) {
+    *pui_Functionality = mod->functionality;
+  }
+  return err;
+}
+EXPORT_SYMBOL(i_APCI1710_GetFunctionality);
+
+int i_APCI1710_SetBoardIntRoutine (struct pci_dev * pdev, void (*InterruptCallback) (struct pci_dev * pdev))
+{
+  sim_board_t *board = simBoardFromPdev(pdev);
+
+  if (!board) {
+    return 1;
+  }
+  if (!InterruptCallback) {
+    return 2;
+  }
+  board->callback = InterruptCallback;
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_SetBoardIntRoutine);
+
+int i_APCI1710_ResetBoardIntRoutine (struct pci_dev * pdev)
+{
+  sim_board_t *board = simBoardFromPdev(pdev);
+
+  if (!board) {
+    return 1;
+  }
+  board->callback = NULL;
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_ResetBoardIntRoutine);
+
+/*
+ * Reports one pending latch per call, the first latch register first.
+ * Returns 1 when nothing is pending; there is no IRQ number to return
+ * otherwise, so 0.
+ */
+int i_APCI1710_TestInterrupt (struct pci_dev *pdev, uint8_t* pb_ModuleMask,
+                              uint32_t* pul_InterruptMask, uint32_t* pul_CounterLatchValue)
+{
+  sim_board_t *board = simBoardFromPdev(pdev);
+  sim_module_t *mod;
+  int ii;
+  uint8_t reg;
+
+  *pb_ModuleMask = 0xFF;
+  *pul_InterruptMask = 0;
+  *pul_CounterLatchValue = 0;
+  if (!board) {
+    return 1;
+  }
+  for (ii = 0; ii < SIM_NUM_MODULES; ii++) {
+    mod = board->module + ii;
+    if (mod->pending) {
+      reg = (mod->pending & 1) ? 0 : 1;
+      mod->pending &= ~(1 << reg);
+      *pb_ModuleMask = ii;
+      *pul_InterruptMask = 1;
+      *pul_CounterLatchValue = mod->latch[reg];
+      return 0;
+    }
+  }
+  return 1;
+}
+EXPORT_SYMBOL(i_APCI1710_TestInterrupt);
+
+int i_APCI1710_InitCounter (struct pci_dev *pdev, uint8_t b_ModulNbr, uint8_t b_CounterRange,
+                            uint8_t b_FirstCounterModus, uint8_t b_FirstCounterOption,
+                            uint8_t b_SecondCounterModus, uint8_t b_SecondCounterOption)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (mod->functionality != APCI1710_INCREMENTAL_COUNTER) {
+    return 2;
+  }
+  if (b_CounterRange != APCI1710_32BIT_COUNTER) {
+    /* only the 32-bit range is simulated */
+    return 3;
+  }
+  switch (b_FirstCounterModus) {
+    case APCI1710_QUADRUPLE_MODE:
+      mod->modeFactor = 4;
+      break;
+    case APCI1710_DOUBLE_MODE:
+      mod->modeFactor = 2;
+      break;
+    case APCI1710_SIMPLE_MODE:
+      mod->modeFactor = 1;
+      break;
+    default:
+      return 4;
+  }
+  mod->count = 0;
+  mod->remainder = 0;
+  mod->last = ktime_get();
+  mod->initialized = true;
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_InitCounter);
+
+int i_APCI1710_SetInputFilter (struct pci_dev *pdev, uint8_t b_ModulNbr, uint8_t b_PCIInputClock, uint8_t b_Filter)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (mod->functionality != APCI1710_INCREMENTAL_COUNTER) {
+    return 3;
+  }
+  mod->filter = b_Filter;
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_SetInputFilter);
+
+int i_APCI1710_Read32BitCounterValue (struct pci_dev *pdev, uint8_t b_ModulNbr, uint32_t * pul_CounterValue)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (!mod->initialized) {
+    return 3;
+  }
+  simCountLocked(mod, ktime_get());
+  *pul_CounterValue = (uint32_t)mod->count;
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_Read32BitCounterValue);
+
+int i_APCI1710_Write32BitCounterValue (struct pci_dev *pdev, uint8_t b_ModulNbr, uint32_t ul_WriteValue)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (!mod->initialized) {
+    return 3;
+  }
+  simCountLocked(mod, ktime_get());
+  mod->count = (int32_t)ul_WriteValue;
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_Write32BitCounterValue);
+
+int i_APCI1710_LatchCounter (struct pci_dev *pdev, uint8_t b_ModulNbr, uint8_t b_LatchReg)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (!mod->initialized) {
+    return 3;
+  }
+  if (b_LatchReg > 1) {
+    return 4;
+  }
+  simLatchLocked(mod, b_LatchReg, 1);
+  if (mod->pending) {
+    /* the caller holds the board lock: deliver once it has let go */
+    hrtimer_start(&mod->board->swTimer, ktime_set(0, 0), HRTIMER_MODE_REL);
+  }
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_LatchCounter);
+
+/* The status is cleared by reading it. */
+int i_APCI1710_ReadLatchRegisterStatus (struct pci_dev *pdev, uint8_t b_ModulNbr, uint8_t b_LatchReg, uint8_t* pb_LatchStatus)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (!mod->initialized) {
+    return 3;
+  }
+  if (b_LatchReg > 1) {
+    return 4;
+  }
+  *pb_LatchStatus = mod->latchStatus[b_LatchReg];
+  mod->latchStatus[b_LatchReg] = 0;
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_ReadLatchRegisterStatus);
+
+int i_APCI1710_ReadLatchRegisterValue (struct pci_dev *pdev, uint8_t b_ModulNbr, uint8_t b_LatchReg, uint32_t * pul_LatchValue)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (!mod->initialized) {
+    return 3;
+  }
+  if (b_LatchReg > 1) {
+    return 4;
+  }
+  *pul_LatchValue = mod->latch[b_LatchReg];
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_ReadLatchRegisterValue);
+
+int i_APCI1710_EnableLatchInterrupt (struct pci_dev *pdev, uint8_t b_ModulNbr)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (!mod->initialized) {
+    return 3;
+  }
+  if (!mod->board->callback) {
+    return 4;
+  }
+  mod->latchInt = true;
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_EnableLatchInterrupt);
+
+int i_APCI1710_DisableLatchInterrupt (struct pci_dev *pdev, uint8_t b_ModulNbr)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (!mod->initialized) {
+    return 3;
+  }
+  mod->latchInt = false;
+  mod->pending = 0;
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_DisableLatchInterrupt);
+
+int i_APCI1710_SetDigitalChlOn (struct pci_dev *pdev, uint8_t b_ModulNbr)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (mod) {
+    mod->digout = true;
+  }
+  return err;
+}
+EXPORT_SYMBOL(i_APCI1710_SetDigitalChlOn);
+
+int i_APCI1710_SetDigitalChlOff (struct pci_dev *pdev, uint8_t b_ModulNbr)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (mod) {
+    mod->digout = false;
+  }
+  return err;
+}
+EXPORT_SYMBOL(i_APCI1710_SetDigitalChlOff);
+
+/* chronometer: measures periods of its trigger in timingInterval timingUnits */
+
+int i_APCI1710_InitChrono (struct pci_dev *pdev, uint8_t b_ModulNbr, uint8_t b_ChronoMode,
+                           uint8_t b_PCIInputClock, uint8_t b_TimingUnit, uint32_t ul_TimingInterval)
+{
+  static const u64 unitNs[] = { 1, NSEC_PER_USEC, NSEC_PER_MSEC, NSEC_PER_SEC, 60 * NSEC_PER_SEC };
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (mod->functionality != APCI1710_CHRONOMETER) {
+    return 3;
+  }
+  if (b_ChronoMode > 7) {
+    return 4;
+  }
+  if (b_TimingUnit >= ARRAY_SIZE(unitNs)) {
+    return 6;
+  }
+  if (!ul_TimingInterval) {
+    return 7;
+  }
+  mod->chronoUnit = unitNs[b_TimingUnit] * ul_TimingInterval;
+  mod->chronoInit = true;
+  mod->chronoEnabled = false;
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_InitChrono);
+
+int i_APCI1710_EnableChrono (struct pci_dev *pdev, uint8_t b_ModulNbr, uint8_t b_CycleMode, uint8_t b_InterruptEnable)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (mod->functionality != APCI1710_CHRONOMETER) {
+    return 3;
+  }
+  if (!mod->chronoInit) {
+    return 4;
+  }
+  mod->chronoStatus = 0;
+  mod->chronoValue = 0;
+  mod->chronoEnabled = true;
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_EnableChrono);
+
+int i_APCI1710_DisableChrono (struct pci_dev *pdev, uint8_t b_ModulNbr)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (mod->functionality != APCI1710_CHRONOMETER) {
+    return 3;
+  }
+  mod->chronoEnabled = false;
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_DisableChrono);
+
+int i_APCI1710_ReadChronoValue (struct pci_dev *pdev, uint8_t b_ModulNbr, uint32_t ul_TimeOut,
+                                uint8_t *pb_ChronoStatus, uint32_t *pul_ChronoValue)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (mod->functionality != APCI1710_CHRONOMETER) {
+    return 3;
+  }
+  if (!mod->chronoInit) {
+    return 4;
+  }
+  if (mod->chronoEnabled) {
+    *pb_ChronoStatus = mod->chronoStatus;
+    *pul_ChronoValue = mod->chronoValue;
+  } else {
+    *pb_ChronoStatus = 0;
+    *pul_ChronoValue = 0;
+  }
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_ReadChronoValue);
+
+/* pulse encoder: values are kept, but never run down */
+
+int i_APCI1710_InitPulseEncoder (struct pci_dev *pdev, uint8_t b_ModulNbr, uint8_t b_PulseEncoderNbr,
+                                 uint8_t b_InputLevelSelection, uint8_t b_TriggerOutputAction, uint32_t ul_StartValue)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (mod->functionality != APCI1710_PULSE_ENCODER) {
+    return 3;
+  }
+  if (b_PulseEncoderNbr > 3) {
+    return 4;
+  }
+  mod->pulseEncValue[b_PulseEncoderNbr] = ul_StartValue;
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_InitPulseEncoder);
+
+int i_APCI1710_EnablePulseEncoder (struct pci_dev *pdev, uint8_t b_ModulNbr, uint8_t b_PulseEncoderNbr,
+                                   uint8_t b_CycleSelection, uint8_t b_InterruptHandling)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (mod->functionality != APCI1710_PULSE_ENCODER) {
+    return 3;
+  }
+  return (b_PulseEncoderNbr > 3) ? 4 : 0;
+}
+EXPORT_SYMBOL(i_APCI1710_EnablePulseEncoder);
+
+int i_APCI1710_DisablePulseEncoder (struct pci_dev *pdev, uint8_t b_ModulNbr, uint8_t b_PulseEncoderNbr)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (mod->functionality != APCI1710_PULSE_ENCODER) {
+    return 3;
+  }
+  return (b_PulseEncoderNbr > 3) ? 4 : 0;
+}
+EXPORT_SYMBOL(i_APCI1710_DisablePulseEncoder);
+
+int i_APCI1710_ReadPulseEncoderStatus (struct pci_dev *pdev, uint8_t b_ModulNbr, uint8_t b_PulseEncoderNbr, uint8_t *pb_Status)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (mod->functionality != APCI1710_PULSE_ENCODER) {
+    return 3;
+  }
+  if (b_PulseEncoderNbr > 3) {
+    return 4;
+  }
+  *pb_Status = 0;
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_ReadPulseEncoderStatus);
+
+int i_APCI1710_ReadPulseEncoderValue (struct pci_dev *pdev, uint8_t b_ModulNbr, uint8_t b_PulseEncoderNbr, uint32_t *pul_ReadValue)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (mod->functionality != APCI1710_PULSE_ENCODER) {
+    return 3;
+  }
+  if (b_PulseEncoderNbr > 3) {
+    return 4;
+  }
+  *pul_ReadValue = mod->pulseEncValue[b_PulseEncoderNbr];
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_ReadPulseEncoderValue);
+
+int i_APCI1710_WritePulseEncoderValue (struct pci_dev *pdev, uint8_t b_ModulNbr, uint8_t b_PulseEncoderNbr, uint32_t ul_WriteValue)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (mod->functionality != APCI1710_PULSE_ENCODER) {
+    return 3;
+  }
+  if (b_PulseEncoderNbr > 3) {
+    return 4;
+  }
+  mod->pulseEncValue[b_PulseEncoderNbr] = ul_WriteValue;
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_WritePulseEncoderValue);
+
+/* EL timers: accepted, but no output is generated */
+
+int i_APCI1710_ELInitDelayAndPulseWidth (struct pci_dev *pdev, uint8_t b_ModulNbr, uint32_t dw_DelayTime,
+                                         uint32_t dw_PulseWidth, uint8_t b_OutputLevel, uint8_t b_HardwareTriggerLevel)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  if (mod->functionality != APCI1710_EL_TIMERS) {
+    return 3;
+  }
+  if (b_OutputLevel > 1) {
+    return 4;
+  }
+  if (b_HardwareTriggerLevel > 1) {
+    return 5;
+  }
+  mod->elInit = true;
+  return 0;
+}
+EXPORT_SYMBOL(i_APCI1710_ELInitDelayAndPulseWidth);
+
+int i_APCI1710_ELEnableTimers (struct pci_dev *pdev, uint8_t b_ModulNbr)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  return (mod->functionality != APCI1710_EL_TIMERS) ? 3 : 0;
+}
+EXPORT_SYMBOL(i_APCI1710_ELEnableTimers);
+
+int i_APCI1710_ELDisableTimers (struct pci_dev *pdev, uint8_t b_ModulNbr)
+{
+  int err;
+  sim_module_t *mod = simModule(pdev, b_ModulNbr, &err);
+
+  if (!mod) {
+    return err;
+  }
+  return (mod->functionality != APCI1710_EL_TIMERS) ? 3 : 0;
+}
+EXPORT_SYMBOL(i_APCI1710_ELDisableTimers);
+
+/* ===== kAPI === ^^^ ============================================ */
+
+/** Called when module loads. */
+static int __init apci1710sim_init(void)
+{
+  sim_board_t *board;
+  sim_module_t *mod;
+  int bb, ii;
+
+  if ((boards < 1) || (boards > SIM_MAX_BOARDS)) {
+    printk("%s: boards=%d out of range\n", modulename, boards);
+    return -EINVAL;
+  }
+
+  simBoard = kcalloc(boards, sizeof(sim_board_t), GFP_KERNEL);
+  if (!simBoard) {
+    return -ENOMEM;
+  }
+
+  for (bb = 0; bb < boards; bb++) {
+    board = simBoard + bb;
+    board->index = bb;
+    spin_lock_init(&board->lock);
+    hrtimer_init(&board->swTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    board->swTimer.function = simSwTimer;
+
+    for (ii = 0; ii < SIM_NUM_MODULES; ii++) {
+      mod = board->module + ii;
+      mod->index = ii;
+      mod->board = board;
+      mod->functionality = functionality[ii];
+      mod->modeFactor = 4;
+      mod->last = ktime_get();
+      hrtimer_init(&mod->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+      mod->timer.function = simLatchTimer;
+      if (mod->functionality == APCI1710_INCREMENTAL_COUNTER) {
+        hrtimer_start(&mod->timer, ns_to_ktime(SIM_IDLE_PERIOD), HRTIMER_MODE_REL);
+      }
+    }
+  }
+
+  printk("%s: %d simulated board(s)\n", modulename, boards);
+  return 0;
+}
+
+/** Called when module is unloaded. */
+static void __exit apci1710sim_exit(void)
+{
+  int bb, ii;
+
+  for (bb = 0; bb < boards; bb++) {
+    for (ii = 0; ii < SIM_NUM_MODULES; ii++) {
+      hrtimer_cancel(&simBoard[bb].module[ii].timer);
+    }
+    hrtimer_cancel(&simBoard[bb].swTimer);
+  }
+  kfree(simBoard);
+  simBoard = NULL;
+}
+
+module_exit(apci1710sim_exit);
+module_init(apci1710sim_init);
@@ -0,0 +1,482 @@
+/**
+ * ----------------------------------------------------------------------------
+ * File       : ctrarchive.c
+ * Created    : 2026-10-19
+ * ----------------------------------------------------------------------------
+ * Description:
+ * Capture daemon for apci1710ctr channels, and reader of what it writes.
+ *
+ *   ctrarchive [-o dir] [-b blockKiB] [-s rotateMiB] [-t rotateSec] [-f flushSec] [-D] [-e] device...
+ *   ctrarchive -r file.a17 [-T from,to]
+ *
+ * The daemon drains every device with batched reads and writes the
+ * compact block format of lib/apci1710ctr_archive.h to dir/ctr-<time>.a17,
+ * with one index entry per block in ctr-<time>.a17.idx.  Blocks are
+ * written whole, with O_DIRECT unless -D; the block being filled is
+ * rewritten in place every flushSec so that at most that much is lost in
+ * a crash.  A new file is started after rotateMiB or rotateSec, and on
+ * SIGHUP.  SIGINT and SIGTERM write the last block and exit.  -e enables
+ * the latch interrupt of each channel after opening it.
+ *
+ * -r prints the records of an archive, from the block covering from up to
+ * the block covering to (CLOCK_REALTIME seconds), found through the index.
+ * ----------------------------------------------------------------------------
+ * This file is part of apci1710ctrDriver. It is subject to
+ * the license terms in the LICENSE.txt file found in the top-level directory
+ * of this distribution and at:
+ *   https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of apci1710ctrDriver, including this file, may be
+ * copied, modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+**/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/stat.h>
+
+#include "libapci1710ctr.h"
+#include "apci1710ctr_archive.h"
+
+#define MAX_DEVICES   APCI1710CTR_ARC_CHANNELS
+#define READ_BATCH    256
+#define ALIGN         4096
+
+typedef struct {
+  /* configuration */
+  const char *    dir;
+  size_t          blockSize;
+  uint64_t        rotateBytes;
+  unsigned int    rotateSec;
+  unsigned int    flushSec;
+  bool            direct;
+
+  /* channels */
+  apci1710ctr_t * ctr[MAX_DEVICES];
+  unsigned int    numCtr;
+
+  /* current file */
+  int             fd;
+  FILE *          idx;
+  char            path[4096];
+  uint64_t        offset;         /* of the block being filled */
+  time_t          opened;
+  time_t          flushed;
+
+  /* block being filled */
+  uint8_t *       block;
+  apci1710ctrArcCoder_t coder;
+  bool            blockOpen;
+  uint64_t        seq;
+} archiver_t;
+
+static volatile sig_atomic_t stopRequested, rotateRequested;
+
+static void onSignal(int sig)
+{
+  if (sig == SIGHUP) {
+    rotateRequested = 1;
+  } else {
+    stopRequested = 1;
+  }
+}
+
+static uint64_t clockNs(clockid_t clk)
+{
+  struct timespec ts;
+
+  clock_gettime(clk, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* ===== writer ================================================== */
+
+static int writeAt(archiver_t *a, const void *buf, size_t len, uint64_t offset)
+{
+  ssize_t nn = pwrite(a->fd, buf, len, offset);
+
+  if (nn != (ssize_t)len) {
+    fprintf(stderr, "ctrarchive: %s: write: %s\n", a->path, (nn < 0) ? strerror(errno) : "short");
+    return -1;
+  }
+  return 0;
+}
+
+/* write the block being filled where it belongs, full or not */
+static int blockWrite(archiver_t *a)
+{
+  apci1710ctrArcBlockEnd(&a->coder);
+  return writeAt(a, a->block, a->blockSize, a->offset);
+}
+
+/* write the block for good and index it */
+static int blockClose(archiver_t *a)
+{
+  const apci1710ctrArcBlock_t *hdr = (const apci1710ctrArcBlock_t *)a->block;
+  apci1710ctrArcIndex_t ent;
+
+  if (!a->blockOpen) {
+    return 0;
+  }
+  if (blockWrite(a)) {
+    return -1;
+  }
+  memset(&ent, 0, sizeof(ent));
+  ent.firstSeq = hdr->firstSeq;
+  ent.timeNs = hdr->timeNs;
+  ent.offset = a->offset;
+  ent.records = hdr->records;
+  if ((fwrite(&ent, sizeof(ent), 1, a->idx) != 1) || fflush(a->idx)) {
+    fprintf(stderr, "ctrarchive: %s.idx: %s\n", a->path, strerror(errno));
+    return -1;
+  }
+
+  a->offset += a->blockSize;
+  a->blockOpen = false;
+  return 0;
+}
+
+static int fileClose(archiver_t *a)
+{
+  int rv = 0;
+
+  if (a->fd < 0) {
+    return 0;
+  }
+  rv = blockClose(a);
+  if (fsync(a->fd)) {
+    fprintf(stderr, "ctrarchive: %s: fsync: %s\n", a->path, strerror(errno));
+    rv = -1;
+  }
+  if (close(a->fd)) {
+    fprintf(stderr, "ctrarchive: %s: close: %s\n", a->path, strerror(errno));
+    rv = -1;
+  }
+  if (fclose(a->idx)) {
+    fprintf(stderr, "ctrarchive: %s.idx: %s\n", a->path, strerror(errno));
+    rv = -1;
+  }
+  a->fd = -1;
+  return rv;
+}
+
+static int fileOpen(archiver_t *a)
+{
+  apci1710ctrArcHeader_t *hdr;
+  char idxPath[sizeof(a->path) + 8];
+  char stamp[32];
+  struct tm tm;
+  unsigned int ii;
+  time_t now = time(NULL);
+
+  localtime_r(&now, &tm);
+  strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+  snprintf(a->path, sizeof(a->path), "%s/ctr-%s.a17", a->dir, stamp);
+  snprintf(idxPath, sizeof(idxPath), "%s.idx", a->path);
+
+  a->fd = open(a->path, O_WRONLY | O_CREAT | O_EXCL | (a->direct ? O_DIRECT : 0), 0644);
+  if ((a->fd < 0) && a->direct && (errno == EINVAL)) {
+    /* the file system does not do O_DIRECT */
+    a->direct = false;
+    a->fd = open(a->path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+  }
+  if (a->fd < 0) {
+    fprintf(stderr, "ctrarchive: %s: %s\n", a->path, strerror(errno));
+    return -1;
+  }
+  a->idx = fopen(idxPath, "w");
+  if (!a->idx) {
+    fprintf(stderr, "ctrarchive: %s: %s\n", idxPath, strerror(errno));
+    close(a->fd);
+    a->fd = -1;
+    return -1;
+  }
+
+  /* the header goes through the block buffer, which is aligned */
+  memset(a->block, 0, APCI1710CTR_ARC_HEADER_SIZE);
+  hdr = (apci1710ctrArcHeader_t *)a->block;
+  memcpy(hdr->magic, APCI1710CTR_ARC_MAGIC, sizeof(hdr->magic));
+  hdr->version = APCI1710CTR_ARC_VERSION;
+  hdr->headerSize = APCI1710CTR_ARC_HEADER_SIZE;
+  hdr->blockSize = a->blockSize;
+  hdr->channels = a->numCtr;
+  hdr->createdNs = clockNs(CLOCK_REALTIME);
+  hdr->monoToRealNs = (int64_t)(hdr->createdNs - clockNs(CLOCK_MONOTONIC));
+  for (ii = 0; ii < a->numCtr; ii++) {
+    hdr->minor[ii] = apci1710ctrMinor(a->ctr[ii]);
+  }
+  if (writeAt(a, a->block, APCI1710CTR_ARC_HEADER_SIZE, 0)) {
+    return -1;
+  }
+
+  a->offset = APCI1710CTR_ARC_HEADER_SIZE;
+  a->opened = a->flushed = time(NULL);
+  a->blockOpen = false;
+  return 0;
+}
+
+static int archive(archiver_t *a, unsigned int channel, const apci1710ctrRecord_t *rec)
+{
+  counterBuf_t raw;
+
+  raw.counter = (int32_t)rec->raw;
+  raw.timestamp = rec->timestamp;
+  raw.frameCount = (uint16_t)rec->frame;
+  raw.flags = rec->flags;
+
+  for (;;) {
+    if (!a->blockOpen) {
+      apci1710ctrArcBlockBegin(&a->coder, a->block, a->blockSize, a->seq, clockNs(CLOCK_REALTIME));
+      a->blockOpen = true;
+    }
+    if (!apci1710ctrArcAppend(&a->coder, channel, &raw, rec->lost)) {
+      a->seq++;
+      return 0;
+    }
+    /* block full */
+    if (blockClose(a)) {
+      return -1;
+    }
+    if ((a->offset >= a->rotateBytes) && (fileClose(a) || fileOpen(a))) {
+      return -1;
+    }
+  }
+}
+
+/* ===== writer === ^^^ ========================================== */
+
+static int runArchiver(archiver_t *a)
+{
+  struct pollfd pfd[MAX_DEVICES];
+  apci1710ctrRecord_t *recs = calloc(READ_BATCH, sizeof(apci1710ctrRecord_t));
+  ssize_t nn, jj;
+  unsigned int ii;
+  time_t now;
+
+  if (!recs || fileOpen(a)) {
+    return 1;
+  }
+  for (ii = 0; ii < a->numCtr; ii++) {
+    pfd[ii].fd = apci1710ctrFd(a->ctr[ii]);
+    pfd[ii].events = POLLIN;
+  }
+
+  while (!stopRequested) {
+    if ((poll(pfd, a->numCtr, 1000) < 0) && (errno != EINTR)) {
+      perror("ctrarchive: poll");
+      break;
+    }
+    for (ii = 0; ii < a->numCtr; ii++) {
+      if (!(pfd[ii].revents & POLLIN)) {
+        continue;
+      }
+      while ((nn = apci1710ctrRead(a->ctr[ii], recs, READ_BATCH, 0)) > 0) {
+        for (jj = 0; jj < nn; jj++) {
+          if (archive(a, ii, recs + jj)) {
+            return 1;
+          }
+        }
+        if (nn < READ_BATCH) {
+          break;
+        }
+      }
+    }
+
+    now = time(NULL);
+    if (rotateRequested || (a->rotateSec && (now - a->opened >= a->rotateSec))) {
+      rotateRequested = 0;
+      if (fileClose(a) || fileOpen(a)) {
+        return 1;
+      }
+    } else if (a->blockOpen && (now - a->flushed >= a->flushSec)) {
+      /* same offset, so nothing is wasted */
+      if (blockWrite(a)) {
+        return 1;
+      }
+      a->flushed = now;
+    }
+  }
+
+  free(recs);
+  return fileClose(a) ? 1 : 0;
+}
+
+/* ===== reader ================================================== */
+
+static int runReader(const char *path, double from, double to)
+{
+  apci1710ctrArcHeader_t hdr;
+  apci1710ctrArcIndex_t ent;
+  apci1710ctrArcCoder_t coder;
+  apci1710ctrArcRecord_t rec;
+  char idxPath[4096 + 8];
+  uint64_t fromNs = (uint64_t)(from * 1e9), toNs = (uint64_t)(to * 1e9);
+  uint64_t offset;
+  uint8_t *block;
+  FILE *fp, *idx;
+  long lo, hi, mid, entries;
+  int rv;
+
+  fp = fopen(path, "r");
+  if (!fp || (fread(&hdr, sizeof(hdr), 1, fp) != 1) ||
+      memcmp(hdr.magic, APCI1710CTR_ARC_MAGIC, sizeof(hdr.magic)) || (hdr.version != APCI1710CTR_ARC_VERSION)) {
+    fprintf(stderr, "ctrarchive: %s: not an archive\n", path);
+    return 1;
+  }
+  if ((hdr.blockSize < sizeof(apci1710ctrArcBlock_t)) || (hdr.blockSize > APCI1710CTR_ARC_BLOCK_MAX) ||
+      (hdr.channels > APCI1710CTR_ARC_CHANNELS)) {
+    fprintf(stderr, "ctrarchive: %s: bad header\n", path);
+    fclose(fp);
+    return 1;
+  }
+  block = malloc(hdr.blockSize);
+  if (!block) {
+    fprintf(stderr, "ctrarchive: out of memory\n");
+    fclose(fp);
+    return 1;
+  }
+  offset = hdr.headerSize;
+
+  /* last block that starts at or before from */
+  snprintf(idxPath, sizeof(idxPath), "%s.idx", path);
+  idx = fopen(idxPath, "r");
+  if (idx && fromNs) {
+    fseek(idx, 0, SEEK_END);
+    entries = ftell(idx) / sizeof(ent);
+    lo = 0;
+    hi = entries - 1;
+    while (lo <= hi) {
+      mid = (lo + hi) / 2;
+      fseek(idx, mid * sizeof(ent), SEEK_SET);
+      if (fread(&ent, sizeof(ent), 1, idx) != 1) {
+        break;
+      }
+      if (ent.timeNs <= fromNs) {
+        offset = ent.offset;
+        lo = mid + 1;
+      } else {
+        hi = mid - 1;
+      }
+    }
+  }
+  if (idx) {
+    fclose(idx);
+  }
+
+  printf("# seq minor counter timestamp frame flags lost\n");
+  while (!fseeko(fp, offset, SEEK_SET) && (fread(block, hdr.blockSize, 1, fp) == 1)) {
+    if (apci1710ctrArcBlockOpen(&coder, block, hdr.blockSize)) {
+      fprintf(stderr, "ctrarchive: %s: bad block at %llu\n", path, (unsigned long long)offset);
+      break;
+    }
+    if (toNs && (((const apci1710ctrArcBlock_t *)block)->timeNs > toNs)) {
+      break;
+    }
+    while ((rv = apci1710ctrArcNext(&coder, &rec)) > 0) {
+      printf("%llu %u %d %u %u 0x%x %u\n", (unsigned long long)rec.seq, hdr.minor[rec.channel],
+             rec.rec.counter, rec.rec.timestamp, rec.rec.frameCount, rec.rec.flags, rec.lost);
+    }
+    if (rv < 0) {
+      fprintf(stderr, "ctrarchive: %s: corrupt block at %llu\n", path, (unsigned long long)offset);
+      break;
+    }
+    offset += hdr.blockSize;
+  }
+
+  free(block);
+  fclose(fp);
+  return 0;
+}
+
+/* ===== reader === ^^^ ========================================== */
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-o dir] [-b blockKiB] [-s rotateMiB] [-t rotateSec] [-f flushSec] [-D] [-e] device...\n"
+          "       %s -r file.a17 [-T from,to]\n", name, name);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  archiver_t a;
+  struct sigaction sa;
+  const char *readPath = NULL;
+  double from = 0, to = 0;
+  bool enable = false;
+  unsigned int ii;
+  int opt;
+
+  memset(&a, 0, sizeof(a));
+  a.dir = ".";
+  a.blockSize = APCI1710CTR_ARC_BLOCK_DEFAULT;
+  a.rotateBytes = 1024ull << 20;
+  a.rotateSec = 3600;
+  a.flushSec = 10;
+  a.direct = true;
+  a.fd = -1;
+
+  while ((opt = getopt(argc, argv, "o:b:s:t:f:Der:T:")) != -1) {
+    switch (opt) {
+      case 'o': a.dir = optarg;                                       break;
+      case 'b': a.blockSize = strtoul(optarg, NULL, 0) << 10;         break;
+      case 's': a.rotateBytes = strtoull(optarg, NULL, 0) << 20;      break;
+      case 't': a.rotateSec = strtoul(optarg, NULL, 0);               break;
+      case 'f': a.flushSec = strtoul(optarg, NULL, 0);                break;
+      case 'D': a.direct = false;                                     break;
+      case 'e': enable = true;                                        break;
+      case 'r': readPath = optarg;                                    break;
+      case 'T':
+        if (sscanf(optarg, "%lf,%lf", &from, &to) < 1) {
+          usage(argv[0]);
+        }
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (readPath) {
+    return runReader(readPath, from, to);
+  }
+  if ((optind >= argc) || (a.blockSize < ALIGN) || (a.blockSize % ALIGN) ||
+      (a.blockSize > APCI1710CTR_ARC_BLOCK_MAX) || !a.rotateBytes) {
+    usage(argv[0]);
+  }
+
+  for (ii = 0; (optind < argc) && (ii < MAX_DEVICES); ii++, optind++) {
+    a.ctr[ii] = apci1710ctrOpen(argv[optind], 0);
+    if (!a.ctr[ii]) {
+      fprintf(stderr, "ctrarchive: %s: %s\n", argv[optind], strerror(errno));
+      return 1;
+    }
+    if (enable && apci1710ctrIntEnable(a.ctr[ii])) {
+      fprintf(stderr, "ctrarchive: %s: interrupt enable: %s\n", argv[optind], strerror(errno));
+      return 1;
+    }
+    a.numCtr++;
+  }
+
+  if (posix_memalign((void **)&a.block, ALIGN, a.blockSize)) {
+    fprintf(stderr, "ctrarchive: out of memory\n");
+    return 1;
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = onSignal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGHUP, &sa, NULL);
+
+  return runArchiver(&a);
+}
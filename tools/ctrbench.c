@@ -0,0 +1,400 @@
+/**
+ * ----------------------------------------------------------------------------
+ * File       : ctrbench.c
+ * Created    : 2026-10-19
+ * ----------------------------------------------------------------------------
+ * Description:
+ * End-to-end benchmark of the apci1710ctr char device path.  Each device
+ * is fed by the driver's event injector (APCI1710CTR_IOCINJECT, load the
+ * module with inject=1 and run as root) and drained with one of
+ *
+ *   read    one record per read(), as the original readers do
+ *   batch   readv() of up to -b records, blocking
+ *   poll    poll() on all devices, then nonblocking readv() until EAGAIN
+ *
+ * It reports events/s, records lost to ring overflow, CPU time per event
+ * for this process and for the whole machine, and capture-to-user latency
+ * percentiles from the record timestamps, which are CLOCK_MONOTONIC
+ * microseconds taken in the injecting timer.
+ *
+ *   ctrbench [-n events] [-r rate] [-m read|batch|poll] [-b batch] [-x] device...
+ *
+ * With -x nothing is injected and hardware (or apci1710sim) events are
+ * measured instead; the run ends after -n events per device or when the
+ * devices have been idle for a second.
+ * ----------------------------------------------------------------------------
+ * This file is part of apci1710ctrDriver. It is subject to
+ * the license terms in the LICENSE.txt file found in the top-level directory
+ * of this distribution and at:
+ *   https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of apci1710ctrDriver, including this file, may be
+ * copied, modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+**/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+
+#include "apci1710ctr_ioctl.h"
+#include "apci1710ctr_buf.h"
+
+#define MAX_DEVICES   32
+#define IDLE_TIMEOUT  1000        /* ms without records that ends a run */
+
+enum { MODE_READ, MODE_BATCH, MODE_POLL };
+
+typedef struct {
+  const char *    name;
+  int             fd;
+  unsigned long   received;
+  unsigned long   gaps;           /* records missing from the sequence */
+  bool            started;
+  int32_t         nextCounter;
+  uint32_t *      latency;        /* us, one per record */
+  unsigned long   latencyCount;
+  bool            done;
+} bench_dev_t;
+
+static unsigned long events = 100000;
+static unsigned int rate = 10000;
+static int mode = MODE_READ;
+static unsigned int batch = 64;
+static bool noInject = false;
+
+static bench_dev_t devs[MAX_DEVICES];
+static pthread_t threads[MAX_DEVICES];
+static unsigned int numDevs;
+
+static uint64_t nowUs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+/* busy and total jiffies of the whole machine, from /proc/stat */
+static void cpuTicks(unsigned long long *busy, unsigned long long *total)
+{
+  unsigned long long v[8] = { 0 };
+  FILE *fp = fopen("/proc/stat", "r");
+  int ii;
+
+  *busy = *total = 0;
+  if (!fp) {
+    return;
+  }
+  if (fscanf(fp, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+             v, v + 1, v + 2, v + 3, v + 4, v + 5, v + 6, v + 7) == 8) {
+    for (ii = 0; ii < 8; ii++) {
+      *total += v[ii];
+    }
+    *busy = *total - v[3] - v[4];   /* less idle and iowait */
+  }
+  fclose(fp);
+}
+
+static double processCpuSec(void)
+{
+  struct rusage ru;
+
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static int cmpU32(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+static void printPercentiles(uint32_t *v, unsigned long n)
+{
+  static const double pct[] = { 50.0, 90.0, 99.0, 99.9 };
+  unsigned int ii;
+
+  if (!n) {
+    printf("  latency  (no timestamped records)\n");
+    return;
+  }
+  qsort(v, n, sizeof(*v), cmpU32);
+  printf("  latency ");
+  for (ii = 0; ii < sizeof(pct) / sizeof(pct[0]); ii++) {
+    printf(" p%-4g %7u", pct[ii], v[(unsigned long)(pct[ii] / 100.0 * (n - 1))]);
+  }
+  printf("  max %7u us\n", v[n - 1]);
+}
+
+/*
+ * account -
+ *
+ * Sequence and latency bookkeeping for one record.  Injected records
+ * count up by one from 0, so a gap is a lost record.
+ */
+static void account(bench_dev_t *dev, const counterBuf_t *rec, uint32_t now)
+{
+  if (rec->flags & APCI1710CTR_FLAG_INJECT) {
+    if (dev->started && (rec->counter != dev->nextCounter)) {
+      dev->gaps += (uint32_t)(rec->counter - dev->nextCounter);
+    }
+    dev->started = true;
+    dev->nextCounter = rec->counter + 1;
+  }
+  if (!(rec->flags & (APCI1710CTR_FLAG_CHRONO | APCI1710CTR_FLAG_GROUP)) &&
+      (dev->latencyCount < events)) {
+    dev->latency[dev->latencyCount++] = now - rec->timestamp;
+  }
+  if (++dev->received >= events) {
+    dev->done = true;
+  }
+}
+
+/* records read, 0 for EAGAIN, -1 on error */
+static int readRecords(bench_dev_t *dev, counterBuf_t *buf, unsigned int max)
+{
+  struct iovec iov = { buf, max * sizeof(counterBuf_t) };
+  ssize_t nn;
+  uint32_t now;
+  int ii;
+
+  nn = (max == 1) ? read(dev->fd, buf, sizeof(counterBuf_t)) : readv(dev->fd, &iov, 1);
+  if (nn < 0) {
+    if ((errno == EAGAIN) || (errno == EINTR)) {
+      return 0;
+    }
+    fprintf(stderr, "%s: read: %s\n", dev->name, strerror(errno));
+    return -1;
+  }
+  now = (uint32_t)nowUs();
+  nn /= sizeof(counterBuf_t);
+  for (ii = 0; ii < nn; ii++) {
+    account(dev, buf + ii, now);
+  }
+  return nn;
+}
+
+/* ===== consumers =============================================== */
+
+/* read and batch: one blocking reader thread per device */
+static void *blockingReader(void *arg)
+{
+  bench_dev_t *dev = arg;
+  counterBuf_t *buf = calloc(batch, sizeof(counterBuf_t));
+  unsigned int max = (mode == MODE_READ) ? 1 : batch;
+
+  pthread_cleanup_push(free, buf);
+  while (!dev->done && (readRecords(dev, buf, max) >= 0)) {
+    ;
+  }
+  pthread_cleanup_pop(1);
+  return NULL;
+}
+
+static void pollReader(void)
+{
+  struct pollfd pfd[MAX_DEVICES];
+  counterBuf_t *buf = calloc(batch, sizeof(counterBuf_t));
+  unsigned int ii, open, exc;
+  int nn;
+
+  for (;;) {
+    for (ii = open = 0; ii < numDevs; ii++) {
+      pfd[ii].fd = devs[ii].done ? -1 : devs[ii].fd;
+      pfd[ii].events = POLLIN;
+      open += !devs[ii].done;
+    }
+    if (!open) {
+      break;
+    }
+    nn = poll(pfd, numDevs, IDLE_TIMEOUT);
+    if (nn == 0) {
+      break;                        /* idle */
+    }
+    if ((nn < 0) && (errno != EINTR)) {
+      perror("poll");
+      break;
+    }
+    for (ii = 0; ii < numDevs; ii++) {
+      if (pfd[ii].revents & POLLERR) {
+        /* clears the condition, which poll() would report again at once */
+        ioctl(devs[ii].fd, APCI1710CTR_IOCGETEXCEPTIONS, &exc);
+      }
+      if (pfd[ii].revents & POLLIN) {
+        while (!devs[ii].done && (readRecords(devs + ii, buf, batch) > 0)) {
+          ;
+        }
+      }
+    }
+  }
+  free(buf);
+}
+
+/* ends blocking readers that will never see all their events */
+static void *watchdog(void *arg)
+{
+  unsigned long last = ~0ul, total;
+  unsigned int ii;
+
+  (void)arg;
+  for (;;) {
+    usleep(IDLE_TIMEOUT * 1000);
+    for (ii = total = 0; ii < numDevs; ii++) {
+      total += devs[ii].received;
+    }
+    if (total == last) {
+      for (ii = 0; ii < numDevs; ii++) {
+        if (!devs[ii].done) {
+          devs[ii].done = true;
+          pthread_cancel(threads[ii]);
+        }
+      }
+      return NULL;
+    }
+    last = total;
+  }
+}
+
+/* ===== consumers === ^^^ ======================================= */
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-n events] [-r rate] [-m read|batch|poll] [-b batch] [-x] device...\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t wd;
+  counterInject_t inj;
+  counterStatsChannel_t stats;
+  unsigned long long busy0, total0, busy1, total1;
+  unsigned long received = 0, overflows = 0;
+  uint64_t t0, t1;
+  double cpu0, cpu1, elapsed;
+  unsigned int ii, exc;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:r:m:b:x")) != -1) {
+    switch (opt) {
+      case 'n': events = strtoul(optarg, NULL, 0);   break;
+      case 'r': rate = strtoul(optarg, NULL, 0);     break;
+      case 'b': batch = strtoul(optarg, NULL, 0);    break;
+      case 'x': noInject = true;                     break;
+      case 'm':
+        if (!strcmp(optarg, "read")) {
+          mode = MODE_READ;
+        } else if (!strcmp(optarg, "batch")) {
+          mode = MODE_BATCH;
+        } else if (!strcmp(optarg, "poll")) {
+          mode = MODE_POLL;
+        } else {
+          usage(argv[0]);
+        }
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if ((optind >= argc) || !events || !batch || (!noInject && !rate)) {
+    usage(argv[0]);
+  }
+
+  for (ii = 0; (optind < argc) && (ii < MAX_DEVICES); ii++, optind++) {
+    devs[ii].name = argv[optind];
+    devs[ii].fd = open(argv[optind], O_RDONLY | ((mode == MODE_POLL) ? O_NONBLOCK : 0));
+    if (devs[ii].fd < 0) {
+      fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+      return 1;
+    }
+    devs[ii].latency = malloc(events * sizeof(uint32_t));
+    if (!devs[ii].latency) {
+      fprintf(stderr, "%s: out of memory\n", argv[0]);
+      return 1;
+    }
+    ioctl(devs[ii].fd, APCI1710CTR_IOCRESET);
+    ioctl(devs[ii].fd, APCI1710CTR_IOCGETEXCEPTIONS, &exc);
+    numDevs++;
+  }
+
+  cpuTicks(&busy0, &total0);
+  cpu0 = processCpuSec();
+  t0 = nowUs();
+
+  if (!noInject) {
+    memset(&inj, 0, sizeof(inj));
+    inj.count = events;
+    inj.rate = rate;
+    inj.step = 1;
+    for (ii = 0; ii < numDevs; ii++) {
+      if (ioctl(devs[ii].fd, APCI1710CTR_IOCINJECT, &inj)) {
+        fprintf(stderr, "%s: APCI1710CTR_IOCINJECT: %s%s\n", devs[ii].name, strerror(errno),
+                (errno == EPERM) ? " (load apci1710ctr with inject=1, run as root)" : "");
+        return 1;
+      }
+    }
+  } else {
+    for (ii = 0; ii < numDevs; ii++) {
+      ioctl(devs[ii].fd, APCI1710CTR_IOCINTENABLE);
+    }
+  }
+
+  if (mode == MODE_POLL) {
+    pollReader();
+  } else {
+    pthread_create(&wd, NULL, watchdog, NULL);
+    pthread_detach(wd);
+    for (ii = 0; ii < numDevs; ii++) {
+      pthread_create(threads + ii, NULL, blockingReader, devs + ii);
+    }
+    for (ii = 0; ii < numDevs; ii++) {
+      pthread_join(threads[ii], NULL);
+    }
+  }
+
+  t1 = nowUs();
+  cpu1 = processCpuSec();
+  cpuTicks(&busy1, &total1);
+  elapsed = (t1 - t0) / 1e6;
+
+  printf("mode %s, %u device(s), %lu events each at %u/s%s, batch %u\n",
+         (mode == MODE_READ) ? "read" : (mode == MODE_BATCH) ? "batch" : "poll",
+         numDevs, events, rate, noInject ? " (not injected)" : "", batch);
+  for (ii = 0; ii < numDevs; ii++) {
+    memset(&stats, 0, sizeof(stats));
+    ioctl(devs[ii].fd, APCI1710CTR_IOCGETSTATS, &stats);
+    printf("%s: received %lu, gaps %lu, ring overflows %u, high water %u / %u\n",
+           devs[ii].name, devs[ii].received, devs[ii].gaps, stats.overflowCount,
+           stats.ringHighWater, stats.ringSize - 1);
+    printPercentiles(devs[ii].latency, devs[ii].latencyCount);
+    received += devs[ii].received;
+    overflows += stats.overflowCount;
+    close(devs[ii].fd);
+    free(devs[ii].latency);
+  }
+
+  printf("total: %.0f events/s over %.3f s, received %lu, lost %lu (%.3f%%)\n",
+         received / elapsed, elapsed, received, overflows,
+         (received + overflows) ? 100.0 * overflows / (received + overflows) : 0.0);
+  if (received) {
+    printf("cpu: %.2f us/event in ctrbench, %.2f us/event machine-wide (%llu of %llu ticks busy)\n",
+           (cpu1 - cpu0) * 1e6 / received,
+           (double)(busy1 - busy0) / sysconf(_SC_CLK_TCK) * 1e6 / received,
+           busy1 - busy0, total1 - total0);
+  }
+  return 0;
+}
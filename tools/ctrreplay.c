@@ -0,0 +1,232 @@
+/**
+ * ----------------------------------------------------------------------------
+ * File       : ctrreplay.c
+ * Created    : 2026-10-19
+ * ----------------------------------------------------------------------------
+ * Description:
+ * Feed records from a ctrarchive file back through the driver.
+ *
+ *   ctrreplay [-m minor] [-T from,to] [-x speed] [-w] file.a17 device
+ *
+ * The records of one archived channel (-m, default the first one in the
+ * file), optionally only those in the blocks covering from..to
+ * (CLOCK_REALTIME seconds), are handed to APCI1710CTR_IOCREPLAY on device,
+ * which queues them at their recorded spacing divided by speed (default
+ * 1).  The module must be loaded with inject=1 and this must run as root.
+ * With -w the tool waits until the replay should be over, and stops it on
+ * SIGINT; otherwise it returns once the driver has the records.
+ * ----------------------------------------------------------------------------
+ * This file is part of apci1710ctrDriver. It is subject to
+ * the license terms in the LICENSE.txt file found in the top-level directory
+ * of this distribution and at:
+ *   https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of apci1710ctrDriver, including this file, may be
+ * copied, modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+
+#include "apci1710ctr_ioctl.h"
+#include "apci1710ctr_buf.h"
+#include "apci1710ctr_archive.h"
+
+static volatile sig_atomic_t stopRequested;
+
+static void onSignal(int sig)
+{
+  (void)sig;
+  stopRequested = 1;
+}
+
+/*
+ * loadChannel -
+ *
+ * Decode the records of one channel from the blocks of the archive that
+ * cover from..to (0 = open ended): from the last block starting at or
+ * before from, as ctrarchive -r does, to the last one starting at or
+ * before to.  Returns the number of records in *out, or -1.
+ */
+static long loadChannel(const char *path, int minor, uint64_t fromNs, uint64_t toNs,
+                        counterBuf_t **out)
+{
+  apci1710ctrArcHeader_t hdr;
+  apci1710ctrArcCoder_t coder;
+  apci1710ctrArcRecord_t rec;
+  const apci1710ctrArcBlock_t *blk;
+  counterBuf_t *buf = NULL;
+  long count = 0, alloc = 0;
+  unsigned int channel;
+  apci1710ctrArcBlock_t bh;
+  uint64_t offset;
+  uint8_t *block;
+  FILE *fp;
+  int rv;
+
+  fp = fopen(path, "r");
+  if (!fp || (fread(&hdr, sizeof(hdr), 1, fp) != 1) ||
+      memcmp(hdr.magic, APCI1710CTR_ARC_MAGIC, sizeof(hdr.magic)) || (hdr.version != APCI1710CTR_ARC_VERSION)) {
+    fprintf(stderr, "ctrreplay: %s: not an archive\n", path);
+    return -1;
+  }
+  if ((hdr.blockSize < sizeof(apci1710ctrArcBlock_t)) || (hdr.blockSize > APCI1710CTR_ARC_BLOCK_MAX) ||
+      (hdr.channels > APCI1710CTR_ARC_CHANNELS)) {
+    fprintf(stderr, "ctrreplay: %s: bad header\n", path);
+    fclose(fp);
+    return -1;
+  }
+  for (channel = 0; channel < hdr.channels; channel++) {
+    if ((minor < 0) || (hdr.minor[channel] == (uint32_t)minor)) {
+      break;
+    }
+  }
+  if (channel == hdr.channels) {
+    fprintf(stderr, "ctrreplay: %s: minor %d not archived\n", path, minor);
+    return -1;
+  }
+
+  block = malloc(hdr.blockSize);
+  if (!block) {
+    fprintf(stderr, "ctrreplay: out of memory\n");
+    fclose(fp);
+    return -1;
+  }
+
+  /* last block that starts at or before from, going by the block headers */
+  offset = hdr.headerSize;
+  if (fromNs) {
+    for (;;) {
+      if (fseeko(fp, offset + hdr.blockSize, SEEK_SET) || (fread(&bh, sizeof(bh), 1, fp) != 1) ||
+          (bh.magic != APCI1710CTR_ARC_BLOCK_MAGIC) || (bh.timeNs > fromNs)) {
+        break;
+      }
+      offset += hdr.blockSize;
+    }
+  }
+
+  fseeko(fp, offset, SEEK_SET);
+  while (fread(block, hdr.blockSize, 1, fp) == 1) {
+    if (apci1710ctrArcBlockOpen(&coder, block, hdr.blockSize)) {
+      break;
+    }
+    blk = (const apci1710ctrArcBlock_t *)block;
+    if (toNs && (blk->timeNs > toNs)) {
+      break;
+    }
+    while ((rv = apci1710ctrArcNext(&coder, &rec)) > 0) {
+      if (rec.channel != channel) {
+        continue;
+      }
+      if (count == alloc) {
+        alloc = alloc ? 2 * alloc : 65536;
+        buf = realloc(buf, alloc * sizeof(counterBuf_t));
+        if (!buf) {
+          fprintf(stderr, "ctrreplay: out of memory\n");
+          return -1;
+        }
+      }
+      buf[count++] = rec.rec;
+    }
+    if (rv < 0) {
+      fprintf(stderr, "ctrreplay: %s: corrupt block, stopping there\n", path);
+      break;
+    }
+  }
+
+  printf("%s: minor %u, %ld records\n", path, hdr.minor[channel], count);
+  free(block);
+  fclose(fp);
+  *out = buf;
+  return count;
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-m minor] [-T from,to] [-x speed] [-w] file.a17 device\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  counterReplay_t replay;
+  counterBuf_t *events = NULL;
+  double from = 0, to = 0;
+  unsigned int speed = 1;
+  uint64_t spanUs = 0;
+  int minor = -1, wait = 0;
+  long count, ii;
+  int fd, opt;
+
+  while ((opt = getopt(argc, argv, "m:T:x:w")) != -1) {
+    switch (opt) {
+      case 'm': minor = atoi(optarg);                 break;
+      case 'x': speed = strtoul(optarg, NULL, 0);     break;
+      case 'w': wait = 1;                             break;
+      case 'T':
+        if (sscanf(optarg, "%lf,%lf", &from, &to) < 1) {
+          usage(argv[0]);
+        }
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if ((optind + 2 != argc) || (speed < 1) || (speed > APCI1710CTR_REPLAY_SPEED_MAX)) {
+    usage(argv[0]);
+  }
+
+  count = loadChannel(argv[optind], minor, (uint64_t)(from * 1e9), (uint64_t)(to * 1e9), &events);
+  if (count <= 0) {
+    return 1;
+  }
+  if (count > APCI1710CTR_REPLAY_MAX) {
+    fprintf(stderr, "ctrreplay: replaying the first %d records\n", APCI1710CTR_REPLAY_MAX);
+    count = APCI1710CTR_REPLAY_MAX;
+  }
+  /* the spacing the driver will replay, timestamps wrap at 32 bits */
+  for (ii = 1; ii < count; ii++) {
+    spanUs += (uint32_t)(events[ii].timestamp - events[ii - 1].timestamp);
+  }
+  printf("replaying %ld records over %.3f s\n", count, spanUs / 1e6 / speed);
+
+  fd = open(argv[optind + 1], O_RDONLY | O_NONBLOCK);
+  if (fd < 0) {
+    fprintf(stderr, "ctrreplay: %s: %s\n", argv[optind + 1], strerror(errno));
+    return 1;
+  }
+  memset(&replay, 0, sizeof(replay));
+  replay.events = (unsigned long)events;
+  replay.count = count;
+  replay.speed = speed;
+  if (ioctl(fd, APCI1710CTR_IOCREPLAY, &replay)) {
+    fprintf(stderr, "ctrreplay: APCI1710CTR_IOCREPLAY: %s%s\n", strerror(errno),
+            (errno == EPERM) ? " (needs inject=1 and root)" : "");
+    return 1;
+  }
+  free(events);
+
+  if (wait) {
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    usleep(spanUs / speed % 1000000);
+    for (spanUs = spanUs / speed / 1000000; spanUs && !stopRequested; spanUs--) {
+      sleep(1);
+    }
+    if (stopRequested) {
+      /* count 0 stops it */
+      replay.count = 0;
+      ioctl(fd, APCI1710CTR_IOCREPLAY, &replay);
+    }
+  }
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,194 @@
+/**
+ * ----------------------------------------------------------------------------
+ * File       : decodetest.c
+ * Created    : 2026-10-19
+ * ----------------------------------------------------------------------------
+ * Description:
+ * Test of the capture group latch interrupt decode in
+ * src/apci1710ctr_decode.h against a stub of the latch part of the kAPI,
+ * which behaves like apci1710sim: a latch sets the register's status bit
+ * and a pending interrupt, reading a status clears it, and each
+ * i_APCI1710_TestInterrupt() reports one pending latch, the first module
+ * and the first latch register first.
+ *
+ * Random interleavings of hardware latches, group captures and interrupt
+ * delivery run on several modules, some of them group members.  Every
+ * interrupt for latch register 0 must come out as an event and every one
+ * for register 1 must be recognized as the group's, and groupPending must
+ * be back to 0 once everything has been delivered.
+ *
+ *   make -C tools test
+ *
+ * Prints each failed check and exits nonzero if there was any.
+ * ----------------------------------------------------------------------------
+ * This file is part of apci1710ctrDriver. It is subject to
+ * the license terms in the LICENSE.txt file found in the top-level directory
+ * of this distribution and at:
+ *   https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of apci1710ctrDriver, including this file, may be
+ * copied, modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apci1710ctr_decode.h"
+
+#define NUM_MODULES   4
+#define ROUNDS        200000
+
+/* stub module, as in apci1710sim */
+typedef struct {
+  uint8_t       latchStatus[2];
+  uint8_t       pending;          /* latch registers with an interrupt pending */
+  int           member;           /* in the capture group */
+  unsigned int  groupPending;     /* driver state */
+  unsigned long events;           /* interrupts pushed as events */
+  unsigned long swallowed;        /* interrupts taken for the group's */
+} stubModule_t;
+
+static stubModule_t module[NUM_MODULES];
+static unsigned long statusReads;
+static int failures;
+
+#define CHECK(cond) do {                                                \
+    if (!(cond)) {                                                      \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      failures++;                                                       \
+    }                                                                   \
+  } while (0)
+
+/* i_APCI1710_ReadLatchRegisterStatus(): the status is cleared by reading it */
+static int stubReadStatus(void *ctx, uint8_t reg, uint8_t *status)
+{
+  stubModule_t *mod = ctx;
+
+  statusReads++;
+  *status = mod->latchStatus[reg];
+  mod->latchStatus[reg] = 0;
+  return 0;
+}
+
+/* a latch into register reg, CTR_LATCH_SOFTWARE or CTR_LATCH_HARDWARE */
+static void stubLatch(stubModule_t *mod, uint8_t reg, uint8_t source)
+{
+  mod->latchStatus[reg] |= source;
+  mod->pending |= (1 << reg);
+}
+
+/* i_APCI1710_TestInterrupt(): 0 and the module and register, or 1 */
+static int stubTestInterrupt(unsigned int *mm, uint8_t *reg)
+{
+  unsigned int ii;
+
+  for (ii = 0; ii < NUM_MODULES; ii++) {
+    if (module[ii].pending) {
+      *mm = ii;
+      *reg = (module[ii].pending & 1) ? 0 : 1;
+      module[ii].pending &= ~(1 << *reg);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* apci1710_interrupt() for one latch interrupt; returns 0 when none */
+static int deliverOne(void)
+{
+  stubModule_t *mod;
+  unsigned int mm;
+  uint8_t reg;
+  int swallow;
+
+  if (stubTestInterrupt(&mm, &reg)) {
+    return 0;
+  }
+  mod = module + mm;
+  swallow = mod->member && ctrGroupDecode(&mod->groupPending, stubReadStatus, mod);
+  if (swallow) {
+    mod->swallowed++;
+  } else {
+    mod->events++;
+  }
+
+  /* a hardware latch is an event, a group software latch is not */
+  if (reg == 0) {
+    CHECK(!swallow);
+  } else {
+    CHECK(swallow);
+  }
+  return 1;
+}
+
+/* apci1710_groupCaptureLocked(), interrupts delivered afterwards */
+static void groupCapture(void)
+{
+  unsigned int ii;
+
+  for (ii = 0; ii < NUM_MODULES; ii++) {
+    if (module[ii].member) {
+      stubLatch(module + ii, 1, CTR_LATCH_SOFTWARE);
+      module[ii].groupPending++;
+    }
+  }
+  for (ii = 0; ii < NUM_MODULES; ii++) {
+    if (module[ii].member) {
+      ctrGroupResync(&module[ii].groupPending);
+    }
+  }
+}
+
+static void runSeed(unsigned int seed)
+{
+  unsigned int ii, round;
+  int op;
+
+  memset(module, 0, sizeof(module));
+  srand(seed);
+  for (ii = 0; ii < NUM_MODULES; ii++) {
+    module[ii].member = (seed >> ii) & 1;
+  }
+
+  for (round = 0; round < ROUNDS; round++) {
+    op = rand() % 8;
+    if (op < 3) {
+      stubLatch(module + rand() % NUM_MODULES, 0, CTR_LATCH_HARDWARE);
+    } else if (op < 4) {
+      groupCapture();
+    } else if (op < 7) {
+      deliverOne();
+    } else {
+      while (deliverOne()) {
+      }
+    }
+  }
+  while (deliverOne()) {
+  }
+
+  for (ii = 0; ii < NUM_MODULES; ii++) {
+    CHECK(module[ii].groupPending == 0);
+    if (!module[ii].member) {
+      CHECK(module[ii].swallowed == 0);
+    }
+  }
+}
+
+int main(void)
+{
+  unsigned int seed;
+
+  /* every combination of members, with different interleavings */
+  for (seed = 0; seed < 64; seed++) {
+    runSeed(seed);
+  }
+
+  if (failures) {
+    fprintf(stderr, "decodetest: %d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("decodetest: all checks passed (%lu status reads)\n", statusReads);
+  return 0;
+}
@@ -0,0 +1,360 @@
+/**
+ * ----------------------------------------------------------------------------
+ * File       : ringbench.c
+ * Created    : 2026-10-19
+ * ----------------------------------------------------------------------------
+ * Description:
+ * User-space benchmark of the event ring and interval histogram in
+ * src/apci1710ctr_ring.h, the same code the driver runs in its interrupt
+ * handler.  For each ring size it reports
+ *
+ *  - push and pop cost with no contention,
+ *  - push latency (lock + push, as in the ISR) and end-to-end latency
+ *    percentiles with a producer and a consumer thread running at the
+ *    given rates, and
+ *  - how many events were lost to overflow and how full the ring got.
+ *
+ * A spinlock stands in for the board lock.  Run it before and after a
+ * change to the ring or histogram code.
+ *
+ *   ringbench [-n events] [-s size,size,...] [-p producer Hz] [-c consumer Hz] [-b batch]
+ *             [-r reset Hz]
+ *
+ * Rates of 0 mean as fast as possible.  The consumer pops at most batch
+ * records per wakeup, like a reader with a buffer of that many records.
+ * With -r a third thread resets the ring and frame counter at that rate,
+ * as ringbufReset() does, while the other two run; the consumer checks
+ * that frame counts only ever continue or start over, and the exit status
+ * is nonzero if they did not.  Built as ringbench-debug the invariant
+ * checks of the header are on as well (make -C tools test).
+ * ----------------------------------------------------------------------------
+ * This file is part of apci1710ctrDriver. It is subject to
+ * the license terms in the LICENSE.txt file found in the top-level directory
+ * of this distribution and at:
+ *   https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of apci1710ctrDriver, including this file, may be
+ * copied, modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+**/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "apci1710ctr_ring.h"
+
+#define MAX_SIZES   16
+
+typedef struct {
+  ctrRing_t           ring;
+  ctrStat_t           stat;
+  pthread_spinlock_t  lock;         /* the board lock */
+  int                 frameCount;   /* atomic_t in the driver */
+  int                 overflowCount;
+  unsigned long       events;
+  unsigned long       producerRate;
+  unsigned long       consumerRate;
+  unsigned int        batch;
+  unsigned long       resetRate;
+  unsigned long       resets;
+  unsigned long       frameErrors;  /* records out of frame sequence */
+  volatile int        done;
+  uint32_t *          pushLatency;  /* ns, one per event */
+  uint32_t *          e2eLatency;   /* ns, one per record read */
+  unsigned long       received;
+} bench_t;
+
+static uint64_t nowNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleepUntil(uint64_t t)
+{
+  struct timespec ts;
+
+  ts.tv_sec = t / 1000000000ull;
+  ts.tv_nsec = t % 1000000000ull;
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static int cmpU32(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+static void printPercentiles(const char *name, uint32_t *v, unsigned long n)
+{
+  static const double pct[] = { 50.0, 90.0, 99.0, 99.9 };
+  unsigned int ii;
+
+  printf("  %-8s", name);
+  if (!n) {
+    printf(" (none)\n");
+    return;
+  }
+  qsort(v, n, sizeof(*v), cmpU32);
+  for (ii = 0; ii < sizeof(pct) / sizeof(pct[0]); ii++) {
+    printf(" p%-4g %8u", pct[ii], v[(unsigned long)(pct[ii] / 100.0 * (n - 1))]);
+  }
+  printf("  max %8u ns\n", v[n - 1]);
+}
+
+/* ===== uncontended cost ======================================== */
+
+static void benchSingle(unsigned int size, unsigned long events)
+{
+  counterBuf_t *buf = calloc(size, sizeof(counterBuf_t));
+  ctrRing_t ring;
+  ctrStat_t stat;
+  counterBuf_t el;
+  unsigned long ii, done = 0;
+  unsigned int jj, burst = size - 1;
+  uint64_t t0, tPush = 0, tPop = 0;
+  volatile int32_t sink = 0;
+
+  ctrRingInit(&ring, buf, size);
+  while (done < events) {
+    /* fill, then drain, so that both full and empty rings are exercised */
+    t0 = nowNs();
+    for (jj = 0; jj < burst; jj++) {
+      ctrRingPush(&ring, (int32_t)jj, (uint32_t)jj, (uint16_t)jj, 0);
+    }
+    tPush += nowNs() - t0;
+    t0 = nowNs();
+    for (jj = 0; jj < burst; jj++) {
+      if (ctrRingPop(&ring, &el)) {
+        sink += el.counter;
+      }
+    }
+    tPop += nowNs() - t0;
+    done += burst;
+  }
+
+  memset(&stat, 0, sizeof(stat));
+  ctrStatStart(&stat);
+  t0 = nowNs();
+  for (ii = 0; ii < events; ii++) {
+    ctrStatSample(&stat, ii * 3);
+  }
+  t0 = nowNs() - t0;
+
+  printf("  single   push %6.2f ns  pop %6.2f ns  histogram %6.2f ns\n",
+         (double)tPush / done, (double)tPop / done, (double)t0 / events);
+  free(buf);
+}
+
+/* ===== uncontended cost === ^^^ ================================ */
+
+/* ===== producer/consumer ======================================= */
+
+static void *producer(void *arg)
+{
+  bench_t *b = arg;
+  uint64_t period = b->producerRate ? 1000000000ull / b->producerRate : 0;
+  uint64_t next = nowNs(), t0;
+  unsigned long ii;
+  int frame;
+
+  for (ii = 0; ii < b->events; ii++) {
+    if (period) {
+      next += period;
+      while (nowNs() < next) {
+        /* spin, an interrupt does not wait for the scheduler */
+      }
+    }
+    t0 = nowNs();
+    pthread_spin_lock(&b->lock);
+    frame = __atomic_load_n(&b->frameCount, __ATOMIC_RELAXED);
+    if (ctrRingPush(&b->ring, (int32_t)ii, (uint32_t)t0, (uint16_t)frame, 0)) {
+      __atomic_fetch_add(&b->frameCount, 1, __ATOMIC_RELAXED);
+    } else {
+      __atomic_fetch_add(&b->overflowCount, 1, __ATOMIC_RELAXED);
+    }
+    ctrStatSample(&b->stat, (unsigned long)(t0 / 1000000));
+    pthread_spin_unlock(&b->lock);
+    b->pushLatency[ii] = (uint32_t)(nowNs() - t0);
+  }
+  __atomic_store_n(&b->done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+static void *consumer(void *arg)
+{
+  bench_t *b = arg;
+  uint64_t period = b->consumerRate ? 1000000000ull / b->consumerRate : 0;
+  uint64_t next = nowNs();
+  counterBuf_t el;
+  unsigned int jj;
+  bool got = false, last, first = true;
+  uint16_t expected = 0;
+
+  for (;;) {
+    if (period) {
+      next += period;
+      sleepUntil(next);
+    }
+    last = __atomic_load_n(&b->done, __ATOMIC_ACQUIRE);
+    for (jj = 0; jj < b->batch; jj++) {
+      pthread_spin_lock(&b->lock);
+      got = ctrRingPop(&b->ring, &el);
+      pthread_spin_unlock(&b->lock);
+      if (!got) {
+        break;
+      }
+      /* a reset starts the frame count over */
+      if (!first && (el.frameCount != expected) && (el.frameCount != 0)) {
+        b->frameErrors++;
+      }
+      first = false;
+      expected = el.frameCount + 1;
+      b->e2eLatency[b->received++] = (uint32_t)nowNs() - el.timestamp;
+    }
+    if (last && !got) {
+      return NULL;
+    }
+  }
+}
+
+/* ringbufReset() while the producer and consumer run */
+static void *resetter(void *arg)
+{
+  bench_t *b = arg;
+  uint64_t period = 1000000000ull / b->resetRate;
+  uint64_t next = nowNs();
+
+  while (!__atomic_load_n(&b->done, __ATOMIC_ACQUIRE)) {
+    next += period;
+    sleepUntil(next);
+    pthread_spin_lock(&b->lock);
+    __atomic_store_n(&b->frameCount, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&b->overflowCount, 0, __ATOMIC_RELAXED);
+    ctrRingReset(&b->ring);
+    CTR_CHECK(ctrRingLevel(&b->ring) == 0);
+    pthread_spin_unlock(&b->lock);
+    b->resets++;
+  }
+  return NULL;
+}
+
+static int benchThreaded(bench_t *b, unsigned int size)
+{
+  counterBuf_t *buf = calloc(size, sizeof(counterBuf_t));
+  pthread_t tp, tc, tr;
+  uint64_t t0;
+  double elapsed;
+
+  ctrRingInit(&b->ring, buf, size);
+  memset(&b->stat, 0, sizeof(b->stat));
+  ctrStatStart(&b->stat);
+  b->frameCount = b->overflowCount = 0;
+  b->done = 0;
+  b->received = 0;
+  b->resets = b->frameErrors = 0;
+
+  t0 = nowNs();
+  if (pthread_create(&tc, NULL, consumer, b) || pthread_create(&tp, NULL, producer, b) ||
+      (b->resetRate && pthread_create(&tr, NULL, resetter, b))) {
+    perror("pthread_create");
+    free(buf);
+    return -1;
+  }
+  pthread_join(tp, NULL);
+  pthread_join(tc, NULL);
+  if (b->resetRate) {
+    pthread_join(tr, NULL);
+  }
+  elapsed = (nowNs() - t0) / 1e9;
+
+  printf("  threaded %lu events in %.3f s (%.0f/s), read %lu, overflow %d (%.2f%%), high water %u / %u\n",
+         b->events, elapsed, b->events / elapsed, b->received, b->overflowCount,
+         100.0 * b->overflowCount / b->events, b->ring.highWater, size - 1);
+  if (b->resetRate) {
+    printf("  reset    %lu times, %lu records out of frame sequence\n", b->resets, b->frameErrors);
+  }
+  printPercentiles("push", b->pushLatency, b->events);
+  printPercentiles("e2e", b->e2eLatency, b->received);
+  free(buf);
+  return b->frameErrors ? -1 : 0;
+}
+
+/* ===== producer/consumer === ^^^ =============================== */
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-n events] [-s size,size,...] [-p producer Hz] [-c consumer Hz] [-b batch]"
+          " [-r reset Hz]\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  bench_t b;
+  unsigned int sizes[MAX_SIZES] = { 16, 64, 256, 1024, 4096 };
+  unsigned int numSizes = 5, ii;
+  char *tok;
+  int opt;
+
+  memset(&b, 0, sizeof(b));
+  b.events = 1000000;
+  b.batch = 1;
+
+  while ((opt = getopt(argc, argv, "n:s:p:c:b:r:")) != -1) {
+    switch (opt) {
+      case 'n': b.events = strtoul(optarg, NULL, 0);         break;
+      case 'p': b.producerRate = strtoul(optarg, NULL, 0);   break;
+      case 'c': b.consumerRate = strtoul(optarg, NULL, 0);   break;
+      case 'b': b.batch = strtoul(optarg, NULL, 0);          break;
+      case 'r': b.resetRate = strtoul(optarg, NULL, 0);      break;
+      case 's':
+        numSizes = 0;
+        for (tok = strtok(optarg, ","); tok && (numSizes < MAX_SIZES); tok = strtok(NULL, ",")) {
+          sizes[numSizes++] = strtoul(tok, NULL, 0);
+        }
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (!b.events || !b.batch || !numSizes) {
+    usage(argv[0]);
+  }
+  for (ii = 0; ii < numSizes; ii++) {
+    if ((sizes[ii] < 2) || (sizes[ii] & (sizes[ii] - 1))) {
+      fprintf(stderr, "%s: ring size %u is not a power of 2\n", argv[0], sizes[ii]);
+      return 1;
+    }
+  }
+
+  b.pushLatency = malloc(b.events * sizeof(uint32_t));
+  b.e2eLatency = malloc(b.events * sizeof(uint32_t));
+  pthread_spin_init(&b.lock, PTHREAD_PROCESS_PRIVATE);
+  if (!b.pushLatency || !b.e2eLatency) {
+    fprintf(stderr, "%s: out of memory\n", argv[0]);
+    return 1;
+  }
+
+  printf("events %lu, producer %lu Hz, consumer %lu Hz, batch %u, reset %lu Hz (0 Hz = unpaced)\n",
+         b.events, b.producerRate, b.consumerRate, b.batch, b.resetRate);
+  for (ii = 0; ii < numSizes; ii++) {
+    printf("ring size %u\n", sizes[ii]);
+    benchSingle(sizes[ii], b.events);
+    if (benchThreaded(&b, sizes[ii])) {
+      return 1;
+    }
+  }
+
+  free(b.pushLatency);
+  free(b.e2eLatency);
+  return 0;
+}
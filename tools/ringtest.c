@@ -0,0 +1,205 @@
+/**
+ * ----------------------------------------------------------------------------
+ * File       : ringtest.c
+ * Created    : 2026-10-19
+ * ----------------------------------------------------------------------------
+ * Description:
+ * Unit test of the event ring and interval histogram in
+ * src/apci1710ctr_ring.h.  It is built with APCI1710CTR_DEBUG so the
+ * CTR_CHECK invariants in the header are asserted as well.
+ *
+ *   make -C tools test
+ *
+ * Prints each failed check and exits nonzero if there was any.
+ * ----------------------------------------------------------------------------
+ * This file is part of apci1710ctrDriver. It is subject to
+ * the license terms in the LICENSE.txt file found in the top-level directory
+ * of this distribution and at:
+ *   https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+ * No part of apci1710ctrDriver, including this file, may be
+ * copied, modified, propagated, or distributed except according to the terms
+ * contained in the LICENSE.txt file.
+ * ----------------------------------------------------------------------------
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#include "apci1710ctr_ring.h"
+
+static int failures;
+
+#define CHECK(cond) do {                                                \
+    if (!(cond)) {                                                      \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      failures++;                                                       \
+    }                                                                   \
+  } while (0)
+
+#define RING_SIZE 8
+
+static void testEmptyFull(void)
+{
+  counterBuf_t storage[RING_SIZE], el;
+  ctrRing_t ring;
+  unsigned int ii, head;
+
+  ctrRingInit(&ring, storage, RING_SIZE);
+  CHECK(ctrRingLevel(&ring) == 0);
+  CHECK(!ctrRingPop(&ring, &el));
+
+  /* capacity is size - 1 */
+  for (ii = 0; ii < RING_SIZE - 1; ii++) {
+    CHECK(ctrRingPush(&ring, ii, 1000 + ii, ii, 0));
+  }
+  CHECK(ctrRingLevel(&ring) == RING_SIZE - 1);
+  head = ring.head;
+  CHECK(!ctrRingPush(&ring, 99, 99, RING_SIZE - 1, 0));
+  CHECK((ring.head == head) && (ctrRingLevel(&ring) == RING_SIZE - 1));
+
+  for (ii = 0; ii < RING_SIZE - 1; ii++) {
+    CHECK(ctrRingPop(&ring, &el) &&
+          (el.counter == (int32_t)ii) && (el.timestamp == 1000 + ii) && (el.frameCount == ii));
+  }
+  CHECK(ctrRingLevel(&ring) == 0);
+  CHECK(!ctrRingPop(&ring, &el));
+}
+
+static void testWrap(void)
+{
+  counterBuf_t storage[4], el;
+  ctrRing_t ring;
+  uint16_t pushed = 0xfff0, popped = 0xfff0;
+  unsigned int ii, jj;
+
+  /* indices and frameCount both wrap many times */
+  ctrRingInit(&ring, storage, 4);
+  for (ii = 0; ii < 1000; ii++) {
+    for (jj = 0; jj <= ii % 3; jj++, pushed++) {
+      CHECK(ctrRingPush(&ring, -(int32_t)pushed, pushed, pushed, APCI1710CTR_FLAG_GROUP));
+    }
+    CHECK(ctrRingLevel(&ring) == (uint16_t)(pushed - popped));
+    while (ctrRingPop(&ring, &el)) {
+      CHECK((el.frameCount == popped) && (el.counter == -(int32_t)popped) &&
+            (el.timestamp == popped) && (el.flags == APCI1710CTR_FLAG_GROUP));
+      popped++;
+    }
+  }
+  CHECK(pushed == popped);
+}
+
+static void testHighWater(void)
+{
+  counterBuf_t storage[RING_SIZE], el;
+  ctrRing_t ring;
+  uint16_t frame = 0;
+  int ii;
+
+  ctrRingInit(&ring, storage, RING_SIZE);
+  CHECK(ring.highWater == 0);
+  for (ii = 0; ii < 5; ii++) {
+    ctrRingPush(&ring, 0, 0, frame++, 0);
+  }
+  CHECK(ring.highWater == 5);
+
+  /* draining does not lower it, a fuller ring raises it */
+  for (ii = 0; ii < 3; ii++) {
+    ctrRingPop(&ring, &el);
+  }
+  CHECK(ring.highWater == 5);
+  for (ii = 0; ii < 4; ii++) {
+    ctrRingPush(&ring, 0, 0, frame++, 0);
+  }
+  CHECK(ring.highWater == 6);
+
+  /* a failed push at full leaves it at the capacity */
+  while (ctrRingPush(&ring, 0, 0, frame, 0)) {
+    frame++;
+  }
+  CHECK(ring.highWater == RING_SIZE - 1);
+
+  ctrRingReset(&ring);
+  CHECK((ctrRingLevel(&ring) == 0) && (ring.highWater == 0));
+  ctrRingPush(&ring, 0, 0, 0, 0);
+  CHECK(ring.highWater == 1);
+}
+
+static void testStat(void)
+{
+  ctrStat_t st;
+  int ii, total;
+
+  memset(&st, 0, sizeof(st));
+
+  /* disabled: nothing is counted */
+  CHECK(ctrStatSample(&st, 100) == 0);
+  CHECK(ctrStatSample(&st, 200) == 0);
+  for (ii = 0, total = 0; ii < CTR_STAT_HISTO_BINS; ii++) {
+    total += st.histo[ii];
+  }
+  CHECK(total == 0);
+
+  /* first event only sets the reference */
+  ctrStatStart(&st);
+  CHECK(ctrStatSample(&st, 1000) == 0);
+  CHECK(ctrStatSample(&st, 1003) == 3);
+  CHECK(st.histo[3] == 1);
+
+  /* longer intervals go in the last bin */
+  CHECK(ctrStatSample(&st, 1003 + 500) == 500);
+  CHECK(st.histo[CTR_STAT_HISTO_BINS - 1] == 1);
+  CHECK(ctrStatSample(&st, 1503 + CTR_STAT_HISTO_BINS - 1) == CTR_STAT_HISTO_BINS - 1);
+  CHECK(st.histo[CTR_STAT_HISTO_BINS - 1] == 2);
+
+  /* short intervals are ignored and do not move the reference */
+  st.ignoreEnabled = true;
+  CHECK(ctrStatSample(&st, 2000) > 0);
+  CHECK(ctrStatSample(&st, 2002) == 2);
+  CHECK((st.ignoreCount == 1) && (st.histo[2] == 0));
+  CHECK(ctrStatSample(&st, 2000 + CTR_STAT_IGNORE_TICKS - 1) == CTR_STAT_IGNORE_TICKS - 1);
+  CHECK(st.ignoreCount == 2);
+  CHECK(ctrStatSample(&st, 2000 + CTR_STAT_IGNORE_TICKS) == CTR_STAT_IGNORE_TICKS);
+  CHECK((st.ignoreCount == 2) && (st.histo[CTR_STAT_IGNORE_TICKS] == 1));
+  st.ignoreEnabled = false;
+
+  /* going backwards is reported and not counted */
+  CHECK(ctrStatSample(&st, 3000) == 3000 - 2000 - CTR_STAT_IGNORE_TICKS);
+  total = st.histo[CTR_STAT_HISTO_BINS - 1];
+  CHECK(ctrStatSample(&st, 2990) == -10);
+  CHECK(st.histo[CTR_STAT_HISTO_BINS - 1] == total);
+  CHECK(ctrStatSample(&st, 3001) == 1);
+  CHECK(st.histo[1] == 1);
+
+  /* tick counter wrapping is a short forward interval */
+  ctrStatStart(&st);
+  CHECK(ctrStatSample(&st, ULONG_MAX - 1) == 0);
+  CHECK(ctrStatSample(&st, 2) == 4);
+  CHECK(st.histo[4] == 1);
+
+  /* stop, reset */
+  ctrStatStop(&st);
+  total = st.histo[CTR_STAT_HISTO_BINS - 1];
+  CHECK(ctrStatSample(&st, 1000) == 0);
+  CHECK(st.histo[CTR_STAT_HISTO_BINS - 1] == total);
+  ctrStatReset(&st);
+  for (ii = 0, total = 0; ii < CTR_STAT_HISTO_BINS; ii++) {
+    total += st.histo[ii];
+  }
+  CHECK((total == 0) && (st.ignoreCount == 0));
+}
+
+int main(void)
+{
+  testEmptyFull();
+  testWrap();
+  testHighWater();
+  testStat();
+
+  if (failures) {
+    fprintf(stderr, "ringtest: %d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("ringtest: all checks passed\n");
+  return 0;
+}